@@ -1,5 +1,7 @@
 #include "bimap-element.h"
 
+#include <algorithm>
+
 namespace ct::detail::element {
 ElementBase::ElementBase() = default;
 
@@ -11,7 +13,8 @@ ElementBase::ElementBase(ElementBase* parent, ElementBase* left, ElementBase* ri
 ElementBase::ElementBase(ElementBase&& other) noexcept
     : parent_(other.parent_)
     , left_(other.left_)
-    , right_(other.right_) {
+    , right_(other.right_)
+    , height_(other.height_) {
   reset(other);
 }
 
@@ -20,25 +23,7 @@ void ElementBase::reset(ElementBase& ptr) {
 }
 
 bool ElementBase::is_sentinel() const noexcept {
-  if (!left_ || !right_) {
-    return false;
-  }
-  // empty sentinel
-  if (parent_ == this) {
-    return true;
-  }
-  // root or sentinel
-  if (parent_->parent_ == this) {
-    // sentinel to tree, size() > 1 (not only root)
-    if (left_->parent_ != this || right_->parent_ != this) {
-      return true;
-    }
-    // only root map
-    if (!parent_->left_ && !parent_->right_) {
-      return true;
-    }
-  }
-  return false;
+  return height_ == 0;
 }
 
 bool ElementBase::to_left(ElementBase*& current) noexcept {
@@ -118,33 +103,124 @@ void ElementBase::link_to_parent(
   }
 }
 
+namespace {
+unsigned char height(const ElementBase* node) noexcept {
+  return node ? node->height_ : 0;
+}
+
+void replace_child(ElementBase* parent, ElementBase* old, ElementBase* child) noexcept {
+  if (parent->is_sentinel()) {
+    parent->parent_ = child ? child : parent;
+  } else if (parent->left_ == old) {
+    parent->left_ = child;
+  } else {
+    parent->right_ = child;
+  }
+  if (child) {
+    child->parent_ = parent;
+  }
+}
+
+ElementBase* rotate_left(ElementBase* node) noexcept {
+  ElementBase* pivot = node->right_;
+  node->right_ = pivot->left_;
+  if (node->right_) {
+    node->right_->parent_ = node;
+  }
+  replace_child(node->parent_, node, pivot);
+  pivot->left_ = node;
+  node->parent_ = pivot;
+  ElementBase::update_height(node);
+  ElementBase::update_height(pivot);
+  return pivot;
+}
+
+ElementBase* rotate_right(ElementBase* node) noexcept {
+  ElementBase* pivot = node->left_;
+  node->left_ = pivot->right_;
+  if (node->left_) {
+    node->left_->parent_ = node;
+  }
+  replace_child(node->parent_, node, pivot);
+  pivot->right_ = node;
+  node->parent_ = pivot;
+  ElementBase::update_height(node);
+  ElementBase::update_height(pivot);
+  return pivot;
+}
+} // namespace
+
+void ElementBase::update_height(ElementBase* node) noexcept {
+  node->height_ = std::max(height(node->left_), height(node->right_)) + 1;
+}
+
+void ElementBase::rebalance(ElementBase* node) noexcept {
+  while (node && !node->is_sentinel()) {
+    unsigned char old_height = node->height_;
+    int balance = height(node->left_) - height(node->right_);
+    if (balance > 1) {
+      if (height(node->left_->left_) < height(node->left_->right_)) {
+        rotate_left(node->left_);
+      }
+      node = rotate_right(node);
+    } else if (balance < -1) {
+      if (height(node->right_->right_) < height(node->right_->left_)) {
+        rotate_right(node->right_);
+      }
+      node = rotate_left(node);
+    } else {
+      update_height(node);
+    }
+    // subtree height unchanged, the ancestors are still balanced
+    if (node->height_ == old_height) {
+      return;
+    }
+    node = node->parent_;
+  }
+}
+
 void ElementBase::unlink(ElementBase* node) noexcept {
   if (!node || node->is_sentinel()) {
     return;
   }
-  ElementBase* replace = nullptr;
-  if (node->has_left()) {
-    replace = node->left_;
-    while (to_right(replace)) {}
-    link_to_parent(replace, node->right_, true, false);
-    if (replace->is_right_child()) {
-      link_to_parent(replace->parent_, replace->left_, true, false);
-      link_to_parent(replace, node->left_, false, false);
+  ElementBase* replace = node->left_ ? node->left_ : node->right_;
+  // lowest node whose subtree lost an element
+  ElementBase* changed = node->parent_;
+  if (node->left_ && node->right_) {
+    // the predecessor takes the place of the node
+    while (replace->right_) {
+      replace = replace->right_;
+    }
+    if (replace != node->left_) {
+      changed = replace->parent_;
+      changed->right_ = replace->left_;
+      if (replace->left_) {
+        replace->left_->parent_ = changed;
+      }
+      replace->left_ = node->left_;
+      replace->left_->parent_ = replace;
+    } else {
+      changed = replace;
+    }
+    replace->right_ = node->right_;
+    replace->right_->parent_ = replace;
+    replace->height_ = node->height_;
+  }
+  replace_child(node->parent_, node, replace);
+  // detached node, ready to be linked again
+  *node = ElementBase();
+  rebalance(changed);
+}
+
+void ElementBase::swap_trees(ElementBase& lhs, ElementBase& rhs) noexcept {
+  swap(lhs, rhs);
+  for (ElementBase* sentinel : {&lhs, &rhs}) {
+    if (sentinel->parent_ == &lhs || sentinel->parent_ == &rhs) {
+      reset(*sentinel);
+    } else {
+      sentinel->parent_->parent_ = sentinel;
     }
-  } else if (node->has_right()) {
-    replace = node->right_;
-  }
-  if (node->is_right_child()) {
-    node->parent_->right_ = replace;
-  } else if (node->is_left_child()) {
-    node->parent_->left_ = replace;
-  } else {
-    node->parent_->parent_ = (replace ? replace : node->parent_);
-  }
-  if (replace) {
-    replace->parent_ = node->parent_;
   }
-  reset(*node);
 }
 
 bool ElementBase::is_right_child() const noexcept {
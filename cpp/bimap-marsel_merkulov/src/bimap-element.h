@@ -33,10 +33,19 @@ struct ElementBase {
   static void
   link_to_parent(ElementBase* parent, ElementBase* child, bool compare_result, bool overwrite = true) noexcept;
 
+  // recomputes the height of `node` from its children
+  static void update_height(ElementBase* node) noexcept;
+
+  // restores the AVL invariant on the path from `node` to the root after its subtree has changed
+  static void rebalance(ElementBase* node) noexcept;
+
   bool operator==(const ElementBase& other) const = default;
 
   static void unlink(ElementBase* node) noexcept;
 
+  // exchanges the trees hanging off two sentinels
+  static void swap_trees(ElementBase& lhs, ElementBase& rhs) noexcept;
+
   bool is_right_child() const noexcept;
 
   bool is_left_child() const noexcept;
@@ -48,6 +57,8 @@ struct ElementBase {
   ElementBase* parent_ = nullptr;
   ElementBase* left_ = nullptr;
   ElementBase* right_ = nullptr;
+  // height of the subtree, 0 marks a sentinel
+  unsigned char height_ = 1;
 };
 
 template <typename Side>
@@ -63,6 +74,10 @@ public:
     return key_;
   }
 
+  const Key& get_key() const {
+    return key_;
+  }
+
 private:
   Key key_;
 };
@@ -70,6 +85,7 @@ private:
 template <bool is_left>
 struct SideSentinel : ElementBase {
   SideSentinel() {
+    height_ = 0;
     reset(*this);
   }
 };
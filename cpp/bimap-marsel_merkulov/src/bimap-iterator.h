@@ -5,7 +5,7 @@
 #include <iterator>
 
 namespace ct {
-template <typename TLeft, typename TRight, typename CompareLeft, typename CompareRight>
+template <typename TLeft, typename TRight, typename CompareLeft, typename CompareRight, typename Allocator>
 class Bimap;
 } // namespace ct
 
@@ -28,7 +28,7 @@ public:
   using iterator_tag = std::bidirectional_iterator_tag;
 
 private:
-  template <typename TLeft, typename TRight, typename CompareLeft, typename CompareRight>
+  template <typename TLeft, typename TRight, typename CompareLeft, typename CompareRight, typename Allocator>
   friend class ct::Bimap;
 
   friend OppositeIterator;
@@ -2,15 +2,27 @@
 
 #include "bimap-element.h"
 #include "bimap-iterator.h"
-
+#include "flat-bimap.h"
+
+#include <algorithm>
+#include <bit>
+#include <concepts>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <span>
 #include <stdexcept>
+#include <utility>
+#include <vector>
 
 namespace ct {
 template <
     typename TLeft,
     typename TRight,
     typename CompareLeft = std::less<TLeft>,
-    typename CompareRight = std::less<TRight>>
+    typename CompareRight = std::less<TRight>,
+    typename Allocator = std::allocator<std::pair<TLeft, TRight>>>
 class Bimap {
   using Left = TLeft;
   using Right = TRight;
@@ -57,24 +69,75 @@ class Bimap {
         , RightElement(std::forward<RightValue>(right)) {}
   };
 
+  // one allocation holds both sides of a pair
+  using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Element>;
+  using NodeTraits = std::allocator_traits<NodeAllocator>;
+
 public:
   using LeftIterator = IteratorImpl<LeftSide>;
   using RightIterator = IteratorImpl<RightSide>;
 
 public:
-  explicit Bimap(CompareLeft compare_left = CompareLeft(), CompareRight compare_right = CompareRight())
+  explicit Bimap(
+      CompareLeft compare_left = CompareLeft(),
+      CompareRight compare_right = CompareRight(),
+      const Allocator& allocator = Allocator()
+  )
       : compare_left_(std::move(compare_left))
-      , compare_right_(std::move(compare_right)) {}
+      , compare_right_(std::move(compare_right))
+      , allocator_(allocator) {}
+
+  explicit Bimap(const Allocator& allocator)
+      : Bimap(CompareLeft(), CompareRight(), allocator) {}
+
+  // pairs repeating a key of an earlier pair are skipped, as with `insert`. Input sorted by left keys with all
+  // keys distinct is linked in O(n) on the left side plus one sort by right keys
+  template <std::input_iterator Iterator, std::sentinel_for<Iterator> End>
+  Bimap(
+      Iterator first,
+      End last,
+      CompareLeft compare_left = CompareLeft(),
+      CompareRight compare_right = CompareRight(),
+      const Allocator& allocator = Allocator()
+  )
+      : Bimap(std::move(compare_left), std::move(compare_right), allocator) {
+    std::vector<Element*> elements;
+    if constexpr (std::forward_iterator<Iterator>) {
+      elements.reserve(std::ranges::distance(first, last));
+    }
+    try {
+      for (; first != last; ++first) {
+        auto&& pair = *first;
+        elements.push_back(nullptr);
+        elements.back() = create_element(
+            std::get<0>(std::forward<decltype(pair)>(pair)),
+            std::get<1>(std::forward<decltype(pair)>(pair))
+        );
+      }
+      if (!elements.empty()) {
+        link_all(elements);
+      }
+    } catch (...) {
+      for (auto* element : elements) {
+        if (element) {
+          destroy_element(element);
+        }
+      }
+      throw;
+    }
+  }
 
   Bimap(const Bimap& other)
-      : Bimap(other.compare_left_, other.compare_right_) {
-    for (auto it = other.begin_left(); it != other.end_left(); ++it) {
-      insert(*it, *(it.flip()));
-    }
+      : Bimap(
+            other.compare_left_,
+            other.compare_right_,
+            Allocator(NodeTraits::select_on_container_copy_construction(other.allocator_))
+        ) {
+    clone_from(other);
   }
 
   Bimap(Bimap&& other) noexcept
-      : Bimap(std::move(other.compare_left_), std::move(other.compare_right_)) {
+      : Bimap(std::move(other.compare_left_), std::move(other.compare_right_), Allocator(other.allocator_)) {
     swap_without_compare(*this, other);
   }
 
@@ -104,9 +167,86 @@ public:
     using std::swap;
     swap(lhs.compare_left_, rhs.compare_left_);
     swap(lhs.compare_right_, rhs.compare_right_);
+    swap(lhs.allocator_, rhs.allocator_);
     swap_without_compare(lhs, rhs);
   }
 
+  // moves the pairs of `other` whose keys are both absent here; the rest stay in `other`. Nodes are relinked
+  // without reallocating when the allocators compare equal, otherwise the pairs are copied and erased from `other`
+  void merge(Bimap& other) {
+    if (this == &other) {
+      return;
+    }
+    bool relink = allocator_ == other.allocator_;
+    for (auto it = other.begin_left(); it != other.end_left();) {
+      Element* element = element_of<LeftSide>(it.to_node());
+      auto position = find_position(key_of<LeftSide>(element), key_of<RightSide>(element));
+      if (!position) {
+        ++it;
+      } else if (relink) {
+        ++it;
+        other.extract(element);
+        link(element, *position);
+      } else {
+        insert_at(key_of<LeftSide>(element), key_of<RightSide>(element), position->left, position->right);
+        it = other.erase_left(it);
+      }
+    }
+  }
+
+  void merge(Bimap&& other) {
+    merge(other);
+  }
+
+  // immutable copy with flat sorted arrays for read-mostly use, see `FlatBimap`
+  FlatBimap<Left, Right, CompareLeft, CompareRight> freeze() const& {
+    std::vector<Left> lefts;
+    std::vector<Right> rights;
+    lefts.reserve(size_);
+    rights.reserve(size_);
+    for (auto it = begin_left(); it != end_left(); ++it) {
+      lefts.push_back(*it);
+      rights.push_back(*it.flip());
+    }
+    return FlatBimap<Left, Right, CompareLeft, CompareRight>(
+        std::move(lefts),
+        std::move(rights),
+        compare_left_,
+        compare_right_
+    );
+  }
+
+  // as `freeze() const&`, but moves the keys out and leaves the bimap empty
+  FlatBimap<Left, Right, CompareLeft, CompareRight> freeze() && {
+    std::vector<Left> lefts;
+    std::vector<Right> rights;
+    lefts.reserve(size_);
+    rights.reserve(size_);
+    for (auto it = begin_left(); it != end_left(); ++it) {
+      Element* element = element_of<LeftSide>(it.to_node());
+      lefts.push_back(std::move_if_noexcept(static_cast<LeftElement*>(element)->get_key()));
+      rights.push_back(std::move_if_noexcept(static_cast<RightElement*>(element)->get_key()));
+    }
+    clear();
+    return FlatBimap<Left, Right, CompareLeft, CompareRight>(
+        std::move(lefts),
+        std::move(rights),
+        compare_left_,
+        compare_right_
+    );
+  }
+
+  Allocator get_allocator() const {
+    return Allocator(allocator_);
+  }
+
+  // preallocates storage for `count` more pairs, if the allocator supports it (see `ct::PoolAllocator`)
+  void reserve(std::size_t count)
+    requires requires(NodeAllocator& allocator) { allocator.reserve(count); }
+  {
+    allocator_.reserve(count);
+  }
+
   LeftIterator insert(const Left& left, const Right& right) {
     return insert_impl(left, right);
   }
@@ -123,6 +263,24 @@ public:
     return insert_impl(std::move(left), std::move(right));
   }
 
+  // inserts next to the hints in amortized O(1) if the keys belong right before or right after them,
+  // otherwise as `insert`
+  LeftIterator insert(LeftIterator hint_left, RightIterator hint_right, const Left& left, const Right& right) {
+    return insert_hinted(hint_left, hint_right, left, right);
+  }
+
+  LeftIterator insert(LeftIterator hint_left, RightIterator hint_right, const Left& left, Right&& right) {
+    return insert_hinted(hint_left, hint_right, left, std::move(right));
+  }
+
+  LeftIterator insert(LeftIterator hint_left, RightIterator hint_right, Left&& left, const Right& right) {
+    return insert_hinted(hint_left, hint_right, std::move(left), right);
+  }
+
+  LeftIterator insert(LeftIterator hint_left, RightIterator hint_right, Left&& left, Right&& right) {
+    return insert_hinted(hint_left, hint_right, std::move(left), std::move(right));
+  }
+
   LeftIterator erase_left(LeftIterator it) {
     return left().erase_it_impl(it);
   }
@@ -187,6 +345,68 @@ public:
     return right().template bound_impl<false>(right_value);
   }
 
+  // heterogeneous lookup, available with comparators declaring `is_transparent`
+
+  template <typename K>
+    requires detail::transparent<CompareLeft> && (!std::convertible_to<const K&, LeftIterator>)
+  bool erase_left(const K& left_value) {
+    return left().erase_val_impl(left_value);
+  }
+
+  template <typename K>
+    requires detail::transparent<CompareRight> && (!std::convertible_to<const K&, RightIterator>)
+  bool erase_right(const K& right_value) {
+    return right().erase_val_impl(right_value);
+  }
+
+  template <typename K>
+    requires detail::transparent<CompareLeft>
+  LeftIterator find_left(const K& left_value) const {
+    return left().find_impl(left_value);
+  }
+
+  template <typename K>
+    requires detail::transparent<CompareRight>
+  RightIterator find_right(const K& right_value) const {
+    return right().find_impl(right_value);
+  }
+
+  template <typename K>
+    requires detail::transparent<CompareLeft>
+  const Right& at_left(const K& key) const {
+    return left().at_impl(key);
+  }
+
+  template <typename K>
+    requires detail::transparent<CompareRight>
+  const Left& at_right(const K& key) const {
+    return right().at_impl(key);
+  }
+
+  template <typename K>
+    requires detail::transparent<CompareLeft>
+  LeftIterator lower_bound_left(const K& left_value) const {
+    return left().template bound_impl<true>(left_value);
+  }
+
+  template <typename K>
+    requires detail::transparent<CompareLeft>
+  LeftIterator upper_bound_left(const K& left_value) const {
+    return left().template bound_impl<false>(left_value);
+  }
+
+  template <typename K>
+    requires detail::transparent<CompareRight>
+  RightIterator lower_bound_right(const K& right_value) const {
+    return right().template bound_impl<true>(right_value);
+  }
+
+  template <typename K>
+    requires detail::transparent<CompareRight>
+  RightIterator upper_bound_right(const K& right_value) const {
+    return right().template bound_impl<false>(right_value);
+  }
+
   LeftIterator begin_left() const {
     return LeftIterator(sentinel_.to_base<LeftSide>()->right_);
   }
@@ -231,17 +451,8 @@ private:
   friend void swap_without_compare(Bimap& lhs, Bimap& rhs) noexcept {
     using std::swap;
     swap(lhs.size_, rhs.size_);
-    swap(lhs.sentinel_, rhs.sentinel_);
-    lhs.update_parents();
-    rhs.update_parents();
-  }
-
-  void update_parents() noexcept {
-    if (empty()) {
-      return;
-    }
-    sentinel_.to_base<LeftSide>()->parent_->parent_ = sentinel_.to_base<LeftSide>();
-    sentinel_.to_base<RightSide>()->parent_->parent_ = sentinel_.to_base<RightSide>();
+    Base::swap_trees(*lhs.sentinel_.to_base<LeftSide>(), *rhs.sentinel_.to_base<LeftSide>());
+    Base::swap_trees(*lhs.sentinel_.to_base<RightSide>(), *rhs.sentinel_.to_base<RightSide>());
   }
 
   void clear() noexcept {
@@ -262,6 +473,22 @@ private:
     return insert_at(std::forward<ValueLeft>(left_value), std::forward<ValueRight>(right_value), left_pos, right_pos);
   }
 
+  template <typename ValueLeft, typename ValueRight>
+  LeftIterator insert_hinted(
+      const LeftIterator& hint_left,
+      const RightIterator& hint_right,
+      ValueLeft&& left_value,
+      ValueRight&& right_value
+  ) {
+    auto left_pos = left().find_insert_position(hint_left, left_value);
+    auto right_pos = right().find_insert_position(hint_right, right_value);
+
+    if (!empty() && (left().is_equal(*left_pos, left_value) || right().is_equal(*right_pos, right_value))) {
+      return end_left();
+    }
+    return insert_at(std::forward<ValueLeft>(left_value), std::forward<ValueRight>(right_value), left_pos, right_pos);
+  }
+
   template <typename ValueLeft, typename ValueRight>
   LeftIterator insert_at(
       ValueLeft&& left_value,
@@ -269,23 +496,252 @@ private:
       const LeftIterator& pos_left,
       const RightIterator& pos_right
   ) {
-    bool compare_left = false;
-    bool compare_right = false;
+    Position position{pos_left, pos_right};
     if (!empty()) {
-      compare_left = compare_left_(*pos_left, left_value);
-      compare_right = compare_right_(*pos_right, right_value);
+      position.after_left = compare_left_(*pos_left, left_value);
+      position.after_right = compare_right_(*pos_right, right_value);
     }
 
-    auto* element = new Element(std::forward<ValueLeft>(left_value), std::forward<ValueRight>(right_value));
+    auto* element = create_element(std::forward<ValueLeft>(left_value), std::forward<ValueRight>(right_value));
+    link(element, position);
+    return LeftIterator(static_cast<LeftElement*>(element));
+  }
 
-    LeftElement::link_to_parent(pos_left.to_node(), static_cast<LeftElement*>(element), compare_left);
+  // where a pair goes in both trees: the parents and whether it becomes their right child
+  struct Position {
+    LeftIterator left;
+    RightIterator right;
+    bool after_left = false;
+    bool after_right = false;
+  };
 
-    RightElement::link_to_parent(pos_right.to_node(), static_cast<RightElement*>(element), compare_right);
+  // position of a pair with the given keys, none if one of them is taken
+  std::optional<Position> find_position(const Left& left_key, const Right& right_key) const {
+    Position position{left().find_insert_position(left_key), right().find_insert_position(right_key)};
+    if (empty()) {
+      return position;
+    }
+    if (left().is_equal(*position.left, left_key) || right().is_equal(*position.right, right_key)) {
+      return std::nullopt;
+    }
+    position.after_left = compare_left_(*position.left, left_key);
+    position.after_right = compare_right_(*position.right, right_key);
+    return position;
+  }
 
+  void link(Element* element, const Position& position) noexcept {
+    LeftElement::link_to_parent(position.left.to_node(), static_cast<LeftElement*>(element), position.after_left);
+    RightElement::link_to_parent(position.right.to_node(), static_cast<RightElement*>(element), position.after_right);
     left().update_sentinel();
     right().update_sentinel();
+    Base::rebalance(position.left.to_node());
+    Base::rebalance(position.right.to_node());
     ++size_;
-    return LeftIterator(static_cast<LeftElement*>(element));
+  }
+
+  // detaches `element` from both trees without destroying it
+  void extract(Element* element) noexcept {
+    left().update_sentinel(static_cast<LeftElement*>(element));
+    right().update_sentinel(static_cast<RightElement*>(element));
+    LeftElement::unlink(static_cast<LeftElement*>(element));
+    RightElement::unlink(static_cast<RightElement*>(element));
+    --size_;
+  }
+
+  template <typename Side>
+  static Element* element_of(const Base* node) noexcept {
+    return static_cast<Element*>(static_cast<typename Side::ElementTag*>(const_cast<Base*>(node)));
+  }
+
+  template <typename Side>
+  static const typename Side::Key& key_of(const Element* element) noexcept {
+    return static_cast<const typename Side::ElementTag*>(element)->get_key();
+  }
+
+  template <typename Side>
+  auto element_less() const {
+    return [&compare = get_view<Side>().get_compare()](const Element* lhs, const Element* rhs) {
+      return compare(key_of<Side>(lhs), key_of<Side>(rhs));
+    };
+  }
+
+  // links new elements given in insertion order into the empty bimap. Distinct keys are linked as two perfectly
+  // balanced trees built from the elements sorted by each side; otherwise the elements are linked one by one
+  // and the ones whose keys are taken are destroyed
+  void link_all(std::vector<Element*>& elements) {
+    std::vector<Element*> by_left;
+    std::span<Element*> sorted_left = elements;
+    if (!std::ranges::is_sorted(elements, element_less<LeftSide>())) {
+      by_left = elements;
+      std::ranges::stable_sort(by_left, element_less<LeftSide>());
+      sorted_left = by_left;
+    }
+    std::vector<Element*> by_right(sorted_left.begin(), sorted_left.end());
+    std::ranges::sort(by_right, element_less<RightSide>());
+    auto has_equal = [](const auto& sorted, const auto& less) {
+      return std::ranges::adjacent_find(sorted, [&](auto* lhs, auto* rhs) { return !less(lhs, rhs); }) !=
+             sorted.end();
+    };
+    if (has_equal(sorted_left, element_less<LeftSide>()) || has_equal(by_right, element_less<RightSide>())) {
+      size_t linked = 0;
+      try {
+        for (; linked < elements.size(); ++linked) {
+          auto* element = elements[linked];
+          auto position = find_position(key_of<LeftSide>(element), key_of<RightSide>(element));
+          if (position) {
+            link(element, *position);
+          } else {
+            destroy_element(element);
+          }
+        }
+      } catch (...) {
+        elements.erase(elements.begin(), elements.begin() + linked);
+        throw;
+      }
+      return;
+    }
+    left().attach(build_tree<LeftSide>(sorted_left, nullptr), sorted_left.front(), sorted_left.back());
+    right().attach(build_tree<RightSide>(by_right, nullptr), by_right.front(), by_right.back());
+    size_ = elements.size();
+  }
+
+  template <typename Side>
+  static Base* build_tree(std::span<Element* const> sorted, Base* parent) noexcept {
+    if (sorted.empty()) {
+      return nullptr;
+    }
+    size_t middle = sorted.size() / 2;
+    Base* node = static_cast<typename Side::ElementTag*>(sorted[middle]);
+    node->parent_ = parent;
+    node->left_ = build_tree<Side>(sorted.first(middle), node);
+    node->right_ = build_tree<Side>(sorted.subspan(middle + 1), node);
+    Base::update_height(node);
+    return node;
+  }
+
+  // source elements to their copies while cloning: open addressing with linear probing over a power of two
+  // table at most half full, filled only with fresh keys
+  class CopyTable {
+    using Slot = std::pair<const Element*, Element*>;
+
+  public:
+    explicit CopyTable(size_t count)
+        : slots_(std::bit_ceil(count * 2))
+        , shift_(64 - std::countr_zero(slots_.size())) {}
+
+    Element*& operator[](const Element* source) {
+      size_t index = first_slot(source);
+      while (slots_[index].first) {
+        index = (index + 1) & (slots_.size() - 1);
+      }
+      slots_[index].first = source;
+      return slots_[index].second;
+    }
+
+    const Slot* find(const Element* source) const noexcept {
+      size_t index = first_slot(source);
+      while (slots_[index].first != source) {
+        index = (index + 1) & (slots_.size() - 1);
+      }
+      return &slots_[index];
+    }
+
+    auto begin() const noexcept {
+      return slots_.begin();
+    }
+
+    auto end() const noexcept {
+      return slots_.end();
+    }
+
+  private:
+    size_t first_slot(const Element* source) const noexcept {
+      // Fibonacci hashing, the top bits of the product are the best mixed
+      return (reinterpret_cast<std::uintptr_t>(source) * std::uint64_t{0x9E3779B97F4A7C15}) >> shift_;
+    }
+
+    std::vector<Slot> slots_;
+    unsigned shift_;
+  };
+
+  // copies both trees of `other` into this empty bimap node for node, keeping their shape: no comparisons, O(n)
+  void clone_from(const Bimap& other) {
+    if (other.empty()) {
+      return;
+    }
+    // the right tree is rebuilt through the copies made while cloning the left one
+    CopyTable copies(other.size());
+    try {
+      Base* left_root = clone_subtree<LeftSide>(other.left().get_root(), nullptr, copies);
+      Base* right_root = clone_subtree<RightSide>(other.right().get_root(), nullptr, copies);
+      auto copy_of = [&]<typename Side>(Side, const Base* node) {
+        return copies.find(element_of<Side>(node))->second;
+      };
+      const Base& left_sentinel = other.left().get_sentinel();
+      const Base& right_sentinel = other.right().get_sentinel();
+      left().attach(left_root, copy_of(LeftSide(), left_sentinel.right_), copy_of(LeftSide(), left_sentinel.left_));
+      right().attach(
+          right_root,
+          copy_of(RightSide(), right_sentinel.right_),
+          copy_of(RightSide(), right_sentinel.left_)
+      );
+    } catch (...) {
+      for (auto [source, copy] : copies) {
+        if (copy) {
+          destroy_element(copy);
+        }
+      }
+      throw;
+    }
+    size_ = other.size_;
+  }
+
+  template <typename Side>
+  Base* clone_subtree(const Base* source, Base* parent, CopyTable& copies) {
+    using ElementTag = typename Side::ElementTag;
+    if (!source) {
+      return nullptr;
+    }
+    const Element* element = element_of<Side>(source);
+    Element* copy;
+    if constexpr (Side::is_left) {
+      Element*& slot = copies[element];
+      slot = create_element(
+          static_cast<const LeftElement*>(element)->get_key(),
+          static_cast<const RightElement*>(element)->get_key()
+      );
+      copy = slot;
+    } else {
+      copy = copies.find(element)->second;
+    }
+    Base* node = static_cast<ElementTag*>(copy);
+    node->parent_ = parent;
+    node->height_ = source->height_;
+    node->left_ = clone_subtree<Side>(source->left_, node, copies);
+    node->right_ = clone_subtree<Side>(source->right_, node, copies);
+    return node;
+  }
+
+  template <typename ValueLeft, typename ValueRight>
+  Element* create_element(ValueLeft&& left_value, ValueRight&& right_value) {
+    Element* element = NodeTraits::allocate(allocator_, 1);
+    try {
+      NodeTraits::construct(
+          allocator_,
+          element,
+          std::forward<ValueLeft>(left_value),
+          std::forward<ValueRight>(right_value)
+      );
+    } catch (...) {
+      NodeTraits::deallocate(allocator_, element, 1);
+      throw;
+    }
+    return element;
+  }
+
+  void destroy_element(Element* element) noexcept {
+    NodeTraits::destroy(allocator_, element);
+    NodeTraits::deallocate(allocator_, element, 1);
   }
 
 private:
@@ -293,6 +749,7 @@ private:
   Sentinel sentinel_;
   [[no_unique_address]] CompareLeft compare_left_;
   [[no_unique_address]] CompareRight compare_right_;
+  [[no_unique_address]] NodeAllocator allocator_;
 
 private:
   template <typename Side>
@@ -320,7 +777,6 @@ private:
     using Compare = typename Side::Compare;
     using OppositeSide = typename Side::OppositeSide;
     using ElementTag = typename Side::ElementTag;
-    using OppositeElementTag = typename Side::OppositeSide::ElementTag;
 
     Bimap& map;
 
@@ -397,19 +853,32 @@ private:
       }
     }
 
-    bool is_equal(const Key& lhs, const Key& rhs) const {
+    // hangs a tree built elsewhere off the sentinel
+    void attach(Base* root, Element* min, Element* max) noexcept {
+      auto& sentinel = get_sentinel();
+      sentinel.parent_ = root;
+      root->parent_ = &sentinel;
+      sentinel.left_ = static_cast<ElementTag*>(max);
+      sentinel.right_ = static_cast<ElementTag*>(min);
+    }
+
+    template <typename K>
+    bool is_equal(const Key& lhs, const K& rhs) const {
       return compare(lhs, rhs) == 0;
     }
 
-    bool is_greater(const Key& lhs, const Key& rhs) const {
+    template <typename K>
+    bool is_greater(const Key& lhs, const K& rhs) const {
       return compare(lhs, rhs) < 0;
     }
 
-    bool is_less(const Key& lhs, const Key& rhs) const {
+    template <typename K>
+    bool is_less(const Key& lhs, const K& rhs) const {
       return compare(lhs, rhs) > 0;
     }
 
-    int compare(const Key& lhs, const Key& rhs) const {
+    template <typename K>
+    int compare(const Key& lhs, const K& rhs) const {
       auto& comparator = get_compare();
       if (comparator(lhs, rhs)) {
         return 1;
@@ -420,8 +889,8 @@ private:
       return 0;
     }
 
-    template <bool is_lower_bound>
-    Iterator bound_impl(const Key& key) const {
+    template <bool is_lower_bound, typename K>
+    Iterator bound_impl(const K& key) const {
       auto position = find_insert_position(key);
       if (position == get_end()) {
         return position;
@@ -437,7 +906,7 @@ private:
       requires (!std::is_default_constructible_v<Value>)
     {
       auto position = find_insert_position(key);
-      if (is_equal(*position, key)) {
+      if (!map.empty() && is_equal(*position, key)) {
         return *(position.flip());
       }
       throw std::out_of_range("key not found and no default constructor");
@@ -447,13 +916,13 @@ private:
       requires std::is_default_constructible_v<Value>
     {
       auto position = find_insert_position(key);
-      if (is_equal(*position, key)) {
+      if (!map.empty() && is_equal(*position, key)) {
         return *(position.flip());
       }
       Value value = {};
       auto position_value = map.get_view<OppositeSide>().find_insert_position(value);
 
-      if (!map.get_view<OppositeSide>().is_equal(*position_value, value)) {
+      if (map.empty() || !map.get_view<OppositeSide>().is_equal(*position_value, value)) {
         if constexpr (Side::is_left) {
           return *map.insert_at(key, std::move(value), position, position_value).flip();
         } else {
@@ -482,12 +951,8 @@ private:
         auto* current = static_cast<Element*>(to_element_tag(it_start.to_node()));
 
         ++it_start;
-        map.left().update_sentinel(static_cast<Base*>(static_cast<LeftElement*>(current)));
-        map.right().update_sentinel(static_cast<Base*>(static_cast<RightElement*>(current)));
-        ElementTag::unlink(static_cast<ElementTag*>(current));
-        OppositeElementTag::unlink(static_cast<OppositeElementTag*>(current));
-        delete current;
-        --map.size_;
+        map.extract(current);
+        map.destroy_element(current);
       }
 
       return it_end;
@@ -499,16 +964,18 @@ private:
       return erase_it_impl(it_pos, next);
     }
 
-    bool erase_val_impl(const Key& key) {
-      auto erasable = find_insert_position(key);
-      if (!is_equal(*erasable, key)) {
+    template <typename K>
+    bool erase_val_impl(const K& key) {
+      auto erasable = find_impl(key);
+      if (erasable == get_end()) {
         return false;
       }
       erase_it_impl(erasable);
       return true;
     }
 
-    Iterator find_impl(const Key& key) const {
+    template <typename K>
+    Iterator find_impl(const K& key) const {
       auto position = find_insert_position(key);
       if (!map.empty() && is_equal(*position, key)) {
         return position;
@@ -516,7 +983,8 @@ private:
       return get_end();
     }
 
-    const Value& at_impl(const Key& key) const {
+    template <typename K>
+    const Value& at_impl(const K& key) const {
       auto position = find_impl(key);
       if (position == get_end()) {
         throw std::out_of_range("key not found");
@@ -524,7 +992,8 @@ private:
       return *(position.flip());
     }
 
-    Iterator find_insert_position(const Key& value) const {
+    template <typename K>
+    Iterator find_insert_position(const K& value) const {
       Base* root = get_root();
       if (map.empty()) {
         return get_end();
@@ -550,6 +1019,36 @@ private:
       }
       std::unreachable();
     }
+
+    // like `find_insert_position`, but only looks next to `hint` when `key` belongs right before or right after it
+    Iterator find_insert_position(Iterator hint, const Key& key) const {
+      if (map.empty()) {
+        return get_end();
+      }
+      if (hint == get_end() || is_greater(*hint, key)) {
+        if (hint == get_begin()) {
+          return hint;
+        }
+        auto prev = hint;
+        --prev;
+        if (is_less(*prev, key)) {
+          // between neighbours, one of them has the free child slot
+          return hint != get_end() && !hint.to_node()->has_left() ? hint : prev;
+        }
+        if (!is_greater(*prev, key)) {
+          return prev;
+        }
+      } else if (is_less(*hint, key)) {
+        auto next = hint;
+        ++next;
+        if (next == get_end() || is_greater(*next, key)) {
+          return !hint.to_node()->has_right() ? hint : next;
+        }
+      } else {
+        return hint;
+      }
+      return find_insert_position(key);
+    }
   };
 };
 } // namespace ct
@@ -0,0 +1,367 @@
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ct::detail {
+template <typename Compare>
+concept transparent = requires { typename Compare::is_transparent; };
+
+// first position in `sorted` where `before(element)` is false. The range halves on every step without branching
+// on the comparison, so the loop has a fixed trip count and no mispredictions
+template <typename T, typename Before>
+std::size_t partition_point(std::span<const T> sorted, Before before) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  const T* base = sorted.data();
+  std::size_t length = sorted.size();
+  while (length > 1) {
+    std::size_t half = length / 2;
+    base += before(base[half - 1]) ? half : 0;
+    length -= half;
+  }
+  return base - sorted.data() + before(*base);
+}
+} // namespace ct::detail
+
+namespace ct {
+template <typename TLeft, typename TRight, typename CompareLeft, typename CompareRight, typename Allocator>
+class Bimap;
+
+// Immutable bimap produced by `Bimap::freeze()`: the keys of each side in a sorted contiguous array and, for
+// every position, the position of the opposite key in the other array. Lookups are branchless binary searches
+template <
+    typename TLeft,
+    typename TRight,
+    typename CompareLeft = std::less<TLeft>,
+    typename CompareRight = std::less<TRight>>
+class FlatBimap {
+  using Left = TLeft;
+  using Right = TRight;
+
+  template <bool left>
+  struct SideTrait {
+    static constexpr bool is_left = left;
+    using Key = std::conditional_t<is_left, Left, Right>;
+    using Value = std::conditional_t<is_left, Right, Left>;
+    using Compare = std::conditional_t<is_left, CompareLeft, CompareRight>;
+    using OppositeSide = SideTrait<!is_left>;
+  };
+
+  using LeftSide = SideTrait<true>;
+  using RightSide = SideTrait<false>;
+
+  template <typename Side>
+  class IteratorImpl {
+    using Key = typename Side::Key;
+    using OppositeIterator = IteratorImpl<typename Side::OppositeSide>;
+
+  public:
+    using value_type = Key;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Key*;
+    using reference = const Key&;
+    using iterator_category = std::bidirectional_iterator_tag;
+
+  private:
+    friend class FlatBimap;
+
+    friend OppositeIterator;
+
+    IteratorImpl(const FlatBimap* map, std::size_t index)
+        : map_(map)
+        , index_(index) {}
+
+  public:
+    IteratorImpl() = default;
+
+    const Key& operator*() const {
+      return map_->keys<Side>()[index_];
+    }
+
+    const Key* operator->() const {
+      return &operator*();
+    }
+
+    IteratorImpl& operator++() {
+      ++index_;
+      return *this;
+    }
+
+    IteratorImpl operator++(int) {
+      IteratorImpl tmp = *this;
+      operator++();
+      return tmp;
+    }
+
+    IteratorImpl& operator--() {
+      --index_;
+      return *this;
+    }
+
+    IteratorImpl operator--(int) {
+      IteratorImpl tmp = *this;
+      operator--();
+      return tmp;
+    }
+
+    friend bool operator==(const IteratorImpl& lhs, const IteratorImpl& rhs) noexcept {
+      return lhs.index_ == rhs.index_;
+    }
+
+    friend bool operator!=(const IteratorImpl& lhs, const IteratorImpl& rhs) noexcept {
+      return !(lhs == rhs);
+    }
+
+    OppositeIterator flip() const {
+      if (index_ == map_->size()) {
+        return OppositeIterator(map_, index_);
+      }
+      return OppositeIterator(map_, map_->opposite<Side>()[index_]);
+    }
+
+  private:
+    const FlatBimap* map_ = nullptr;
+    std::size_t index_ = 0;
+  };
+
+public:
+  using LeftIterator = IteratorImpl<LeftSide>;
+  using RightIterator = IteratorImpl<RightSide>;
+
+public:
+  explicit FlatBimap(CompareLeft compare_left = CompareLeft(), CompareRight compare_right = CompareRight())
+      : compare_left_(std::move(compare_left))
+      , compare_right_(std::move(compare_right)) {}
+
+  LeftIterator find_left(const Left& left_value) const {
+    return find_impl<LeftSide>(left_value);
+  }
+
+  RightIterator find_right(const Right& right_value) const {
+    return find_impl<RightSide>(right_value);
+  }
+
+  const Right& at_left(const Left& key) const {
+    return at_impl<LeftSide>(key);
+  }
+
+  const Left& at_right(const Right& key) const {
+    return at_impl<RightSide>(key);
+  }
+
+  LeftIterator lower_bound_left(const Left& left_value) const {
+    return lower_bound_impl<LeftSide>(left_value);
+  }
+
+  LeftIterator upper_bound_left(const Left& left_value) const {
+    return upper_bound_impl<LeftSide>(left_value);
+  }
+
+  RightIterator lower_bound_right(const Right& right_value) const {
+    return lower_bound_impl<RightSide>(right_value);
+  }
+
+  RightIterator upper_bound_right(const Right& right_value) const {
+    return upper_bound_impl<RightSide>(right_value);
+  }
+
+  // heterogeneous lookup, available with comparators declaring `is_transparent`
+
+  template <typename K>
+    requires detail::transparent<CompareLeft>
+  LeftIterator find_left(const K& left_value) const {
+    return find_impl<LeftSide>(left_value);
+  }
+
+  template <typename K>
+    requires detail::transparent<CompareRight>
+  RightIterator find_right(const K& right_value) const {
+    return find_impl<RightSide>(right_value);
+  }
+
+  template <typename K>
+    requires detail::transparent<CompareLeft>
+  const Right& at_left(const K& key) const {
+    return at_impl<LeftSide>(key);
+  }
+
+  template <typename K>
+    requires detail::transparent<CompareRight>
+  const Left& at_right(const K& key) const {
+    return at_impl<RightSide>(key);
+  }
+
+  template <typename K>
+    requires detail::transparent<CompareLeft>
+  LeftIterator lower_bound_left(const K& left_value) const {
+    return lower_bound_impl<LeftSide>(left_value);
+  }
+
+  template <typename K>
+    requires detail::transparent<CompareLeft>
+  LeftIterator upper_bound_left(const K& left_value) const {
+    return upper_bound_impl<LeftSide>(left_value);
+  }
+
+  template <typename K>
+    requires detail::transparent<CompareRight>
+  RightIterator lower_bound_right(const K& right_value) const {
+    return lower_bound_impl<RightSide>(right_value);
+  }
+
+  template <typename K>
+    requires detail::transparent<CompareRight>
+  RightIterator upper_bound_right(const K& right_value) const {
+    return upper_bound_impl<RightSide>(right_value);
+  }
+
+  LeftIterator begin_left() const {
+    return LeftIterator(this, 0);
+  }
+
+  LeftIterator end_left() const {
+    return LeftIterator(this, size());
+  }
+
+  RightIterator begin_right() const {
+    return RightIterator(this, 0);
+  }
+
+  RightIterator end_right() const {
+    return RightIterator(this, size());
+  }
+
+  bool empty() const noexcept {
+    return size() == 0;
+  }
+
+  std::size_t size() const noexcept {
+    return left_.size();
+  }
+
+  friend bool operator==(const FlatBimap& lhs, const FlatBimap& rhs) {
+    if (lhs.size() != rhs.size()) {
+      return false;
+    }
+    auto equal = [](const auto& compare, const auto& a, const auto& b) {
+      return !compare(a, b) && !compare(b, a);
+    };
+    for (std::size_t i = 0; i < lhs.size(); ++i) {
+      if (!equal(lhs.compare_left_, lhs.left_[i], rhs.left_[i]) ||
+          !equal(lhs.compare_right_, lhs.right_[lhs.left_to_right_[i]], rhs.right_[rhs.left_to_right_[i]])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  friend bool operator!=(const FlatBimap& lhs, const FlatBimap& rhs) {
+    return !(lhs == rhs);
+  }
+
+private:
+  template <typename, typename, typename, typename, typename>
+  friend class Bimap;
+
+  // `left` sorted by the left comparator with `right[i]` paired to `left[i]`; the keys are distinct
+  FlatBimap(std::vector<Left> left, std::vector<Right> right, CompareLeft compare_left, CompareRight compare_right)
+      : FlatBimap(std::move(compare_left), std::move(compare_right)) {
+    std::size_t count = left.size();
+    std::vector<std::size_t> order(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      order[i] = i;
+    }
+    std::ranges::sort(order, [&](std::size_t lhs, std::size_t rhs) { return compare_right_(right[lhs], right[rhs]); });
+    left_to_right_.resize(count);
+    right_to_left_ = std::move(order);
+    right_.reserve(count);
+    for (std::size_t j = 0; j < count; ++j) {
+      left_to_right_[right_to_left_[j]] = j;
+      right_.push_back(std::move(right[right_to_left_[j]]));
+    }
+    left_ = std::move(left);
+  }
+
+  template <typename Side>
+  std::span<const typename Side::Key> keys() const noexcept {
+    if constexpr (Side::is_left) {
+      return left_;
+    } else {
+      return right_;
+    }
+  }
+
+  template <typename Side>
+  const std::vector<std::size_t>& opposite() const noexcept {
+    if constexpr (Side::is_left) {
+      return left_to_right_;
+    } else {
+      return right_to_left_;
+    }
+  }
+
+  template <typename Side>
+  const typename Side::Compare& get_compare() const noexcept {
+    if constexpr (Side::is_left) {
+      return compare_left_;
+    } else {
+      return compare_right_;
+    }
+  }
+
+  template <typename Side, typename K>
+  std::size_t lower_index(const K& key) const {
+    return detail::partition_point(keys<Side>(), [&](const typename Side::Key& element) {
+      return get_compare<Side>()(element, key);
+    });
+  }
+
+  template <typename Side, typename K>
+  IteratorImpl<Side> lower_bound_impl(const K& key) const {
+    return IteratorImpl<Side>(this, lower_index<Side>(key));
+  }
+
+  template <typename Side, typename K>
+  IteratorImpl<Side> upper_bound_impl(const K& key) const {
+    return IteratorImpl<Side>(this, detail::partition_point(keys<Side>(), [&](const typename Side::Key& element) {
+                                return !get_compare<Side>()(key, element);
+                              }));
+  }
+
+  template <typename Side, typename K>
+  IteratorImpl<Side> find_impl(const K& key) const {
+    std::size_t index = lower_index<Side>(key);
+    if (index == size() || get_compare<Side>()(key, keys<Side>()[index])) {
+      index = size();
+    }
+    return IteratorImpl<Side>(this, index);
+  }
+
+  template <typename Side, typename K>
+  const typename Side::Value& at_impl(const K& key) const {
+    auto position = find_impl<Side>(key);
+    if (position.index_ == size()) {
+      throw std::out_of_range("key not found");
+    }
+    return *position.flip();
+  }
+
+private:
+  std::vector<Left> left_;
+  std::vector<Right> right_;
+  std::vector<std::size_t> left_to_right_;
+  std::vector<std::size_t> right_to_left_;
+  [[no_unique_address]] CompareLeft compare_left_;
+  [[no_unique_address]] CompareRight compare_right_;
+};
+} // namespace ct
@@ -0,0 +1,54 @@
+#include "pool-allocator.h"
+
+#include <algorithm>
+
+namespace ct::detail {
+NodePool::NodePool(std::size_t size, std::size_t alignment)
+    : size_(size)
+    , alignment_(std::max(alignment, alignof(FreeBlock))) {
+  // blocks are laid out back to back, so each one has to keep the next aligned
+  std::size_t block = std::max(size, sizeof(FreeBlock));
+  stride_ = (block + alignment_ - 1) / alignment_ * alignment_;
+}
+
+NodePool::~NodePool() {
+  for (void* chunk : chunks_) {
+    ::operator delete(chunk, std::align_val_t(alignment_));
+  }
+}
+
+std::size_t NodePool::block_size() const noexcept {
+  return size_;
+}
+
+void* NodePool::allocate() {
+  if (!free_) {
+    add_chunk(next_chunk_);
+    next_chunk_ *= 2;
+  }
+  FreeBlock* block = free_;
+  free_ = block->next;
+  --available_;
+  return block;
+}
+
+void NodePool::deallocate(void* block) noexcept {
+  free_ = ::new (block) FreeBlock{free_};
+  ++available_;
+}
+
+void NodePool::reserve(std::size_t count) {
+  if (count > available_) {
+    add_chunk(count - available_);
+  }
+}
+
+void NodePool::add_chunk(std::size_t count) {
+  chunks_.reserve(chunks_.size() + 1);
+  auto* chunk = static_cast<std::byte*>(::operator new(count * stride_, std::align_val_t(alignment_)));
+  chunks_.push_back(chunk);
+  for (std::size_t i = count; i-- > 0;) {
+    deallocate(chunk + i * stride_);
+  }
+}
+} // namespace ct::detail
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace ct::detail {
+// Fixed-size blocks carved from chunks; freed blocks are kept in an intrusive list and reused
+class NodePool {
+public:
+  NodePool(std::size_t size, std::size_t alignment);
+
+  NodePool(const NodePool&) = delete;
+
+  NodePool& operator=(const NodePool&) = delete;
+
+  ~NodePool();
+
+  std::size_t block_size() const noexcept;
+
+  void* allocate();
+
+  void deallocate(void* block) noexcept;
+
+  // makes sure the next `count` allocations don't touch the global allocator
+  void reserve(std::size_t count);
+
+private:
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  void add_chunk(std::size_t count);
+
+  std::size_t size_;
+  std::size_t alignment_;
+  std::size_t stride_;
+  FreeBlock* free_ = nullptr;
+  std::size_t available_ = 0;
+  std::size_t next_chunk_ = 16;
+  std::vector<void*> chunks_;
+};
+
+// the pool of a family of `PoolAllocator` copies, created by the first allocation of the node type
+struct SharedPool {
+  std::unique_ptr<NodePool> pool;
+};
+} // namespace ct::detail
+
+namespace ct {
+// Allocator recycling single-object allocations through a `NodePool` shared by all its copies and rebinds.
+// The copies share a `SharedPool` from construction on, so they compare equal whether or not they have
+// allocated; its pool is created by the first single-object allocation (or `reserve`). Not thread-safe
+template <typename T>
+class PoolAllocator {
+  template <typename U>
+  friend class PoolAllocator;
+
+public:
+  using value_type = T;
+  using propagate_on_container_copy_assignment = std::true_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  PoolAllocator()
+      : shared_(std::make_shared<detail::SharedPool>()) {}
+
+  // copies instead of moving, so that a moved-from allocator still has a pool
+  PoolAllocator(const PoolAllocator& other) noexcept = default;
+
+  PoolAllocator& operator=(const PoolAllocator& other) noexcept = default;
+
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>& other) noexcept
+      : shared_(other.shared_) {}
+
+  // a copied container gets a pool of its own
+  PoolAllocator select_on_container_copy_construction() const {
+    return PoolAllocator();
+  }
+
+  T* allocate(std::size_t n) {
+    if (n != 1 || !pooled()) {
+      return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+    }
+    return static_cast<T*>(shared_->pool->allocate());
+  }
+
+  void deallocate(T* ptr, std::size_t n) noexcept {
+    detail::NodePool* pool = shared_->pool.get();
+    if (n != 1 || !pool || pool->block_size() != sizeof(T)) {
+      ::operator delete(ptr, n * sizeof(T), std::align_val_t(alignof(T)));
+      return;
+    }
+    pool->deallocate(ptr);
+  }
+
+  void reserve(std::size_t count) {
+    if (pooled()) {
+      shared_->pool->reserve(count);
+    }
+  }
+
+  template <typename U>
+  friend bool operator==(const PoolAllocator& lhs, const PoolAllocator<U>& rhs) noexcept {
+    return lhs.shared_ == rhs.shared_;
+  }
+
+private:
+  bool pooled() {
+    if (!shared_->pool) {
+      shared_->pool = std::make_unique<detail::NodePool>(sizeof(T), alignof(T));
+    }
+    return shared_->pool->block_size() == sizeof(T);
+  }
+
+  std::shared_ptr<detail::SharedPool> shared_;
+};
+} // namespace ct
@@ -0,0 +1,696 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace ct::detail::unordered {
+// every pair is linked into one list shared by both sides, which is the iteration order of both
+struct ListNode {
+  ListNode* prev_ = this;
+  ListNode* next_ = this;
+};
+
+// link of one side of a pair in a bucket chain, with the hash of its key
+struct ChainNode {
+  ChainNode* next_ = nullptr;
+  std::size_t hash_ = 0;
+};
+
+template <typename Side>
+class SideNode : public ChainNode {
+  using Key = typename Side::Key;
+
+public:
+  template <typename KeyValue>
+  explicit SideNode(KeyValue&& value)
+      : key_(std::forward<KeyValue>(value)) {}
+
+  const Key& get_key() const {
+    return key_;
+  }
+
+private:
+  Key key_;
+};
+
+template <typename Hash, typename Equal>
+concept transparent = requires {
+  typename Hash::is_transparent;
+  typename Equal::is_transparent;
+};
+} // namespace ct::detail::unordered
+
+namespace ct {
+// Bimap without ordering: each side is a hash table with intrusive chaining through the pairs themselves, so
+// a pair is still one allocation, and finding, inserting and erasing take O(1) on average
+template <
+    typename TLeft,
+    typename TRight,
+    typename HashLeft = std::hash<TLeft>,
+    typename HashRight = std::hash<TRight>,
+    typename EqualLeft = std::equal_to<TLeft>,
+    typename EqualRight = std::equal_to<TRight>,
+    typename Allocator = std::allocator<std::pair<TLeft, TRight>>>
+class UnorderedBimap {
+  using Left = TLeft;
+  using Right = TRight;
+
+  using ListNode = detail::unordered::ListNode;
+  using ChainNode = detail::unordered::ChainNode;
+
+  class Element;
+
+  template <bool left>
+  struct SideTrait {
+    static constexpr bool is_left = left;
+    using Key = std::conditional_t<is_left, Left, Right>;
+    using Value = std::conditional_t<is_left, Right, Left>;
+    using Hash = std::conditional_t<is_left, HashLeft, HashRight>;
+    using Equal = std::conditional_t<is_left, EqualLeft, EqualRight>;
+    using Node = detail::unordered::SideNode<SideTrait>;
+    using OppositeSide = SideTrait<!is_left>;
+  };
+
+  using LeftSide = SideTrait<true>;
+  using RightSide = SideTrait<false>;
+
+  using LeftNode = typename LeftSide::Node;
+  using RightNode = typename RightSide::Node;
+
+  class Element
+      : public ListNode
+      , public LeftNode
+      , public RightNode {
+  public:
+    template <typename LeftValue, typename RightValue>
+    Element(LeftValue&& left, RightValue&& right)
+        : LeftNode(std::forward<LeftValue>(left))
+        , RightNode(std::forward<RightValue>(right)) {}
+  };
+
+  using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Element>;
+  using NodeTraits = std::allocator_traits<NodeAllocator>;
+  using BucketAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<ChainNode*>;
+  using BucketTraits = std::allocator_traits<BucketAllocator>;
+
+  template <typename Side>
+  class IteratorImpl {
+    using Key = typename Side::Key;
+    using OppositeIterator = IteratorImpl<typename Side::OppositeSide>;
+
+  public:
+    using value_type = Key;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Key*;
+    using reference = const Key&;
+    using iterator_category = std::bidirectional_iterator_tag;
+
+  private:
+    friend class UnorderedBimap;
+
+    friend OppositeIterator;
+
+    explicit IteratorImpl(const ListNode* node)
+        : node_(const_cast<ListNode*>(node)) {}
+
+  public:
+    IteratorImpl() = default;
+
+    const Key& operator*() const {
+      return key_of<Side>(static_cast<Element*>(node_));
+    }
+
+    const Key* operator->() const {
+      return &operator*();
+    }
+
+    IteratorImpl& operator++() {
+      node_ = node_->next_;
+      return *this;
+    }
+
+    IteratorImpl operator++(int) {
+      IteratorImpl tmp = *this;
+      operator++();
+      return tmp;
+    }
+
+    IteratorImpl& operator--() {
+      node_ = node_->prev_;
+      return *this;
+    }
+
+    IteratorImpl operator--(int) {
+      IteratorImpl tmp = *this;
+      operator--();
+      return tmp;
+    }
+
+    friend bool operator==(const IteratorImpl& lhs, const IteratorImpl& rhs) noexcept {
+      return lhs.node_ == rhs.node_;
+    }
+
+    friend bool operator!=(const IteratorImpl& lhs, const IteratorImpl& rhs) noexcept {
+      return !(lhs == rhs);
+    }
+
+    // both sides share the list, so the end of one side flips to the end of the other
+    OppositeIterator flip() const {
+      return OppositeIterator(node_);
+    }
+
+  private:
+    ListNode* node_ = nullptr;
+  };
+
+public:
+  using LeftIterator = IteratorImpl<LeftSide>;
+  using RightIterator = IteratorImpl<RightSide>;
+
+public:
+  explicit UnorderedBimap(
+      HashLeft hash_left = HashLeft(),
+      HashRight hash_right = HashRight(),
+      EqualLeft equal_left = EqualLeft(),
+      EqualRight equal_right = EqualRight(),
+      const Allocator& allocator = Allocator()
+  )
+      : hash_left_(std::move(hash_left))
+      , hash_right_(std::move(hash_right))
+      , equal_left_(std::move(equal_left))
+      , equal_right_(std::move(equal_right))
+      , allocator_(allocator) {}
+
+  explicit UnorderedBimap(const Allocator& allocator)
+      : UnorderedBimap(HashLeft(), HashRight(), EqualLeft(), EqualRight(), allocator) {}
+
+  // the keys are known to be distinct and their hashes are copied, so pairs are linked without lookups
+  UnorderedBimap(const UnorderedBimap& other)
+      : UnorderedBimap(
+            other.hash_left_,
+            other.hash_right_,
+            other.equal_left_,
+            other.equal_right_,
+            Allocator(NodeTraits::select_on_container_copy_construction(other.allocator_))
+        ) {
+    reserve(other.size());
+    for (const ListNode* node = other.sentinel_.next_; node != &other.sentinel_; node = node->next_) {
+      auto* source = static_cast<const Element*>(node);
+      Element* element = create_element(key_of<LeftSide>(source), key_of<RightSide>(source));
+      chain_of<LeftSide>(element)->hash_ = hash_of<LeftSide>(source);
+      chain_of<RightSide>(element)->hash_ = hash_of<RightSide>(source);
+      link(element);
+    }
+  }
+
+  UnorderedBimap(UnorderedBimap&& other) noexcept
+      : UnorderedBimap(
+            std::move(other.hash_left_),
+            std::move(other.hash_right_),
+            std::move(other.equal_left_),
+            std::move(other.equal_right_),
+            Allocator(other.allocator_)
+        ) {
+    swap_storage(*this, other);
+  }
+
+  UnorderedBimap& operator=(const UnorderedBimap& other) {
+    if (this != &other) {
+      UnorderedBimap tmp(other);
+      swap(*this, tmp);
+    }
+    return *this;
+  }
+
+  UnorderedBimap& operator=(UnorderedBimap&& other) noexcept {
+    if (this != &other) {
+      UnorderedBimap tmp(std::move(other));
+      swap(*this, tmp);
+    }
+    return *this;
+  }
+
+  ~UnorderedBimap() {
+    clear();
+    if (buckets_) {
+      BucketAllocator allocator(allocator_);
+      BucketTraits::deallocate(allocator, buckets_, 2 * bucket_count_);
+    }
+  }
+
+  friend void swap(UnorderedBimap& lhs, UnorderedBimap& rhs) noexcept {
+    using std::swap;
+    swap(lhs.hash_left_, rhs.hash_left_);
+    swap(lhs.hash_right_, rhs.hash_right_);
+    swap(lhs.equal_left_, rhs.equal_left_);
+    swap(lhs.equal_right_, rhs.equal_right_);
+    swap(lhs.allocator_, rhs.allocator_);
+    swap_storage(lhs, rhs);
+  }
+
+  LeftIterator insert(const Left& left, const Right& right) {
+    return insert_impl(left, right);
+  }
+
+  LeftIterator insert(const Left& left, Right&& right) {
+    return insert_impl(left, std::move(right));
+  }
+
+  LeftIterator insert(Left&& left, const Right& right) {
+    return insert_impl(std::move(left), right);
+  }
+
+  LeftIterator insert(Left&& left, Right&& right) {
+    return insert_impl(std::move(left), std::move(right));
+  }
+
+  LeftIterator erase_left(LeftIterator it) {
+    return erase_it_impl(it);
+  }
+
+  RightIterator erase_right(RightIterator it) {
+    return erase_it_impl(it);
+  }
+
+  bool erase_left(const Left& left_value) {
+    return erase_val_impl<LeftSide>(left_value);
+  }
+
+  bool erase_right(const Right& right_value) {
+    return erase_val_impl<RightSide>(right_value);
+  }
+
+  LeftIterator erase_left(LeftIterator first, LeftIterator last) {
+    return erase_it_impl(first, last);
+  }
+
+  RightIterator erase_right(RightIterator first, RightIterator last) {
+    return erase_it_impl(first, last);
+  }
+
+  LeftIterator find_left(const Left& left_value) const {
+    return find_impl<LeftSide>(left_value);
+  }
+
+  RightIterator find_right(const Right& right_value) const {
+    return find_impl<RightSide>(right_value);
+  }
+
+  const Right& at_left(const Left& key) const {
+    return at_impl<LeftSide>(key);
+  }
+
+  const Left& at_right(const Right& key) const {
+    return at_impl<RightSide>(key);
+  }
+
+  const Right& at_left_or_default(const Left& key) {
+    return at_or_default<LeftSide>(key);
+  }
+
+  const Left& at_right_or_default(const Right& key) {
+    return at_or_default<RightSide>(key);
+  }
+
+  // heterogeneous lookup, available when both the hash and the equality of a side declare `is_transparent`
+
+  template <typename K>
+    requires detail::unordered::transparent<HashLeft, EqualLeft> && (!std::convertible_to<const K&, LeftIterator>)
+  bool erase_left(const K& left_value) {
+    return erase_val_impl<LeftSide>(left_value);
+  }
+
+  template <typename K>
+    requires detail::unordered::transparent<HashRight, EqualRight> && (!std::convertible_to<const K&, RightIterator>)
+  bool erase_right(const K& right_value) {
+    return erase_val_impl<RightSide>(right_value);
+  }
+
+  template <typename K>
+    requires detail::unordered::transparent<HashLeft, EqualLeft>
+  LeftIterator find_left(const K& left_value) const {
+    return find_impl<LeftSide>(left_value);
+  }
+
+  template <typename K>
+    requires detail::unordered::transparent<HashRight, EqualRight>
+  RightIterator find_right(const K& right_value) const {
+    return find_impl<RightSide>(right_value);
+  }
+
+  template <typename K>
+    requires detail::unordered::transparent<HashLeft, EqualLeft>
+  const Right& at_left(const K& key) const {
+    return at_impl<LeftSide>(key);
+  }
+
+  template <typename K>
+    requires detail::unordered::transparent<HashRight, EqualRight>
+  const Left& at_right(const K& key) const {
+    return at_impl<RightSide>(key);
+  }
+
+  LeftIterator begin_left() const {
+    return LeftIterator(sentinel_.next_);
+  }
+
+  LeftIterator end_left() const {
+    return LeftIterator(&sentinel_);
+  }
+
+  RightIterator begin_right() const {
+    return RightIterator(sentinel_.next_);
+  }
+
+  RightIterator end_right() const {
+    return RightIterator(&sentinel_);
+  }
+
+  bool empty() const noexcept {
+    return size() == 0;
+  }
+
+  std::size_t size() const noexcept {
+    return size_;
+  }
+
+  // makes room for `count` pairs without rehashing
+  void reserve(std::size_t count) {
+    if (count > bucket_count_) {
+      rehash(std::bit_ceil(std::max<std::size_t>(count, 8)));
+    }
+  }
+
+  Allocator get_allocator() const {
+    return Allocator(allocator_);
+  }
+
+  // equal as sets of pairs, regardless of the iteration order
+  friend bool operator==(const UnorderedBimap& lhs, const UnorderedBimap& rhs) {
+    if (lhs.size() != rhs.size()) {
+      return false;
+    }
+    for (auto it = lhs.begin_left(); it != lhs.end_left(); ++it) {
+      auto other = rhs.find_left(*it);
+      if (other == rhs.end_left() || !rhs.equal_right_(*other.flip(), *it.flip())) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  friend bool operator!=(const UnorderedBimap& lhs, const UnorderedBimap& rhs) {
+    return !(lhs == rhs);
+  }
+
+private:
+  template <typename Side>
+  static const typename Side::Key& key_of(const Element* element) noexcept {
+    return static_cast<const typename Side::Node*>(element)->get_key();
+  }
+
+  template <typename Side>
+  static ChainNode* chain_of(Element* element) noexcept {
+    return static_cast<typename Side::Node*>(element);
+  }
+
+  template <typename Side>
+  static std::size_t hash_of(const Element* element) noexcept {
+    return static_cast<const typename Side::Node*>(element)->hash_;
+  }
+
+  template <typename Side>
+  static Element* element_of(ChainNode* node) noexcept {
+    return static_cast<Element*>(static_cast<typename Side::Node*>(node));
+  }
+
+  template <typename Side>
+  const typename Side::Hash& get_hash() const noexcept {
+    if constexpr (Side::is_left) {
+      return hash_left_;
+    } else {
+      return hash_right_;
+    }
+  }
+
+  template <typename Side>
+  const typename Side::Equal& get_equal() const noexcept {
+    if constexpr (Side::is_left) {
+      return equal_left_;
+    } else {
+      return equal_right_;
+    }
+  }
+
+  template <typename Side>
+  ChainNode** side_buckets() const noexcept {
+    return Side::is_left ? buckets_ : buckets_ + bucket_count_;
+  }
+
+  // Fibonacci hashing: the top bits of the product, so weak hashes like the identity still spread
+  std::size_t bucket_of(std::size_t hash) const noexcept {
+    return static_cast<std::size_t>((static_cast<std::uint64_t>(hash) * 0x9E3779B97F4A7C15) >> shift_);
+  }
+
+  template <typename Side, typename K>
+  Element* find_element(const K& key, std::size_t hash) const {
+    if (empty()) {
+      return nullptr;
+    }
+    for (ChainNode* node = side_buckets<Side>()[bucket_of(hash)]; node; node = node->next_) {
+      if (node->hash_ == hash && get_equal<Side>()(key_of<Side>(element_of<Side>(node)), key)) {
+        return element_of<Side>(node);
+      }
+    }
+    return nullptr;
+  }
+
+  template <typename Side, typename K>
+  Element* find_element(const K& key) const {
+    return empty() ? nullptr : find_element<Side>(key, get_hash<Side>()(key));
+  }
+
+  template <typename Side>
+  void link_side(Element* element) noexcept {
+    ChainNode* node = chain_of<Side>(element);
+    ChainNode*& head = side_buckets<Side>()[bucket_of(node->hash_)];
+    node->next_ = head;
+    head = node;
+  }
+
+  template <typename Side>
+  void unlink_side(Element* element) noexcept {
+    ChainNode* node = chain_of<Side>(element);
+    ChainNode** link = &side_buckets<Side>()[bucket_of(node->hash_)];
+    while (*link != node) {
+      link = &(*link)->next_;
+    }
+    *link = node->next_;
+  }
+
+  // links an element with its hashes set into both tables and the end of the list; the tables have room
+  void link(Element* element) noexcept {
+    link_side<LeftSide>(element);
+    link_side<RightSide>(element);
+    ListNode* node = element;
+    node->prev_ = sentinel_.prev_;
+    node->next_ = &sentinel_;
+    sentinel_.prev_->next_ = node;
+    sentinel_.prev_ = node;
+    ++size_;
+  }
+
+  void unlink(Element* element) noexcept {
+    unlink_side<LeftSide>(element);
+    unlink_side<RightSide>(element);
+    ListNode* node = element;
+    node->prev_->next_ = node->next_;
+    node->next_->prev_ = node->prev_;
+    --size_;
+  }
+
+  // moves all pairs into `count` buckets per side, using the stored hashes
+  void rehash(std::size_t count) {
+    BucketAllocator allocator(allocator_);
+    ChainNode** buckets = BucketTraits::allocate(allocator, 2 * count);
+    std::uninitialized_fill_n(buckets, 2 * count, nullptr);
+    if (buckets_) {
+      BucketTraits::deallocate(allocator, buckets_, 2 * bucket_count_);
+    }
+    buckets_ = buckets;
+    bucket_count_ = count;
+    shift_ = 64 - std::countr_zero(count);
+    for (ListNode* node = sentinel_.next_; node != &sentinel_; node = node->next_) {
+      link_side<LeftSide>(static_cast<Element*>(node));
+      link_side<RightSide>(static_cast<Element*>(node));
+    }
+  }
+
+  template <typename ValueLeft, typename ValueRight>
+  LeftIterator insert_impl(ValueLeft&& left_value, ValueRight&& right_value) {
+    std::size_t left_hash = hash_left_(left_value);
+    std::size_t right_hash = hash_right_(right_value);
+    if (find_element<LeftSide>(left_value, left_hash) || find_element<RightSide>(right_value, right_hash)) {
+      return end_left();
+    }
+    reserve(size_ + 1);
+    return insert_new(
+        std::forward<ValueLeft>(left_value),
+        std::forward<ValueRight>(right_value),
+        left_hash,
+        right_hash
+    );
+  }
+
+  // inserts a pair whose keys are known to be absent; the tables have room
+  template <typename ValueLeft, typename ValueRight>
+  LeftIterator
+  insert_new(ValueLeft&& left_value, ValueRight&& right_value, std::size_t left_hash, std::size_t right_hash) {
+    Element* element = create_element(std::forward<ValueLeft>(left_value), std::forward<ValueRight>(right_value));
+    chain_of<LeftSide>(element)->hash_ = left_hash;
+    chain_of<RightSide>(element)->hash_ = right_hash;
+    link(element);
+    return LeftIterator(element);
+  }
+
+  template <typename Iterator>
+  Iterator erase_it_impl(Iterator first, Iterator last) noexcept {
+    while (first != last) {
+      auto* element = static_cast<Element*>(first.node_);
+      ++first;
+      unlink(element);
+      destroy_element(element);
+    }
+    return last;
+  }
+
+  template <typename Iterator>
+  Iterator erase_it_impl(Iterator it) noexcept {
+    auto next = it;
+    ++next;
+    return erase_it_impl(it, next);
+  }
+
+  template <typename Side, typename K>
+  bool erase_val_impl(const K& key) {
+    Element* element = find_element<Side>(key);
+    if (!element) {
+      return false;
+    }
+    unlink(element);
+    destroy_element(element);
+    return true;
+  }
+
+  template <typename Side, typename K>
+  IteratorImpl<Side> find_impl(const K& key) const {
+    Element* element = find_element<Side>(key);
+    return IteratorImpl<Side>(element ? static_cast<const ListNode*>(element) : &sentinel_);
+  }
+
+  template <typename Side, typename K>
+  const typename Side::Value& at_impl(const K& key) const {
+    Element* element = find_element<Side>(key);
+    if (!element) {
+      throw std::out_of_range("key not found");
+    }
+    return key_of<typename Side::OppositeSide>(element);
+  }
+
+  // as in `Bimap`: a missing key is inserted with the default opposite key, which is taken from its pair if present
+  template <typename Side>
+  const typename Side::Value& at_or_default(const typename Side::Key& key) {
+    using OppositeSide = typename Side::OppositeSide;
+    using Value = typename Side::Value;
+    std::size_t hash = get_hash<Side>()(key);
+    if (Element* element = find_element<Side>(key, hash)) {
+      return key_of<OppositeSide>(element);
+    }
+    if constexpr (!std::is_default_constructible_v<Value>) {
+      throw std::out_of_range("key not found and no default constructor");
+    } else {
+      Value value = {};
+      std::size_t value_hash = get_hash<OppositeSide>()(value);
+      Element* previous = find_element<OppositeSide>(value, value_hash);
+      reserve(size_ + 1);
+      LeftIterator inserted;
+      if constexpr (Side::is_left) {
+        inserted = insert_new(key, std::move(value), hash, value_hash);
+      } else {
+        inserted = insert_new(std::move(value), key, value_hash, hash);
+      }
+      auto* element = static_cast<Element*>(inserted.node_);
+      if (previous) {
+        unlink(previous);
+        destroy_element(previous);
+      }
+      return key_of<OppositeSide>(element);
+    }
+  }
+
+  void clear() noexcept {
+    erase_it_impl(begin_left(), end_left());
+  }
+
+  friend void swap_storage(UnorderedBimap& lhs, UnorderedBimap& rhs) noexcept {
+    using std::swap;
+    swap(lhs.buckets_, rhs.buckets_);
+    swap(lhs.bucket_count_, rhs.bucket_count_);
+    swap(lhs.shift_, rhs.shift_);
+    swap(lhs.size_, rhs.size_);
+    swap(lhs.sentinel_, rhs.sentinel_);
+    for (ListNode* sentinel : {&lhs.sentinel_, &rhs.sentinel_}) {
+      if (sentinel->next_ == &lhs.sentinel_ || sentinel->next_ == &rhs.sentinel_) {
+        sentinel->prev_ = sentinel->next_ = sentinel;
+      } else {
+        sentinel->next_->prev_ = sentinel;
+        sentinel->prev_->next_ = sentinel;
+      }
+    }
+  }
+
+  template <typename ValueLeft, typename ValueRight>
+  Element* create_element(ValueLeft&& left_value, ValueRight&& right_value) {
+    Element* element = NodeTraits::allocate(allocator_, 1);
+    try {
+      NodeTraits::construct(
+          allocator_,
+          element,
+          std::forward<ValueLeft>(left_value),
+          std::forward<ValueRight>(right_value)
+      );
+    } catch (...) {
+      NodeTraits::deallocate(allocator_, element, 1);
+      throw;
+    }
+    return element;
+  }
+
+  void destroy_element(Element* element) noexcept {
+    NodeTraits::destroy(allocator_, element);
+    NodeTraits::deallocate(allocator_, element, 1);
+  }
+
+private:
+  std::size_t size_ = 0;
+  ListNode sentinel_;
+  // left buckets followed by right buckets, allocated by the first insertion
+  ChainNode** buckets_ = nullptr;
+  std::size_t bucket_count_ = 0;
+  unsigned shift_ = 64;
+  [[no_unique_address]] HashLeft hash_left_;
+  [[no_unique_address]] HashRight hash_right_;
+  [[no_unique_address]] EqualLeft equal_left_;
+  [[no_unique_address]] EqualRight equal_right_;
+  [[no_unique_address]] NodeAllocator allocator_;
+};
+} // namespace ct
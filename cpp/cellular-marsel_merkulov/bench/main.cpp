@@ -0,0 +1,154 @@
+#include "cellular.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Usage: bench [max_threads] [generations]
+// For every dimension, grid size and state size prints cells/s for 1, 2, 4, ... threads, the scaling efficiency
+// relative to one thread and the mean per-step imbalance and barrier wait reported by `stats()`
+
+namespace {
+
+template <size_t Bytes>
+struct Cell {
+  std::array<std::uint8_t, Bytes> bytes{};
+
+  bool operator==(const Cell&) const = default;
+};
+
+template <typename State>
+std::uint8_t value(const State& state) {
+  if constexpr (requires { state.bytes; }) {
+    return state.bytes[0];
+  } else {
+    return static_cast<std::uint8_t>(state);
+  }
+}
+
+template <typename State>
+State make_state(std::uint8_t v) {
+  if constexpr (requires(State state) { state.bytes; }) {
+    State state;
+    state.bytes.fill(v);
+    return state;
+  } else {
+    return static_cast<State>(v);
+  }
+}
+
+// Generic rule touching the radius 1 von Neumann neighbourhood
+template <typename State, size_t D>
+struct Diffuse {
+  static constexpr size_t radius = 1;
+
+  template <typename Grid, typename... Indices>
+  State operator()(const Grid& grid, Indices... indices) const {
+    std::array<size_t, D> cell{static_cast<size_t>(indices)...};
+    unsigned sum = value(grid[cell]) * 3;
+    for (size_t dim = 0; dim < D; ++dim) {
+      std::array<size_t, D> neighbour = cell;
+      size_t extent = grid.extent(dim);
+      neighbour[dim] = (cell[dim] + 1) % extent;
+      sum += value(grid[neighbour]);
+      neighbour[dim] = (cell[dim] + extent - 1) % extent;
+      sum += value(grid[neighbour]);
+    }
+    return make_state<State>(static_cast<std::uint8_t>(sum * 7 / (2 * D + 3)));
+  }
+};
+
+struct Sample {
+  double cells_per_second;
+  double imbalance;
+  double wait_share;
+};
+
+template <typename State, size_t D>
+Sample measure(const std::array<size_t, D>& extents, size_t threads, size_t generations) {
+  ct::CellularAutomaton<State, Diffuse<State, D>, D> automaton(extents, threads);
+  size_t cells = 1;
+  for (size_t extent : extents) {
+    cells *= extent;
+  }
+  {
+    auto grid = automaton.edit();
+    std::array<size_t, D> indices{};
+    for (size_t cell = 0; cell < cells; ++cell) {
+      grid[indices] = make_state<State>(static_cast<std::uint8_t>(cell * 2654435761u >> 24));
+      for (size_t dim = D; dim-- > 0;) {
+        if (++indices[dim] < extents[dim]) {
+          break;
+        }
+        indices[dim] = 0;
+      }
+    }
+  }
+  automaton.step();
+
+  double imbalance = 0;
+  double wait_share = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t generation = 0; generation < generations; ++generation) {
+    automaton.step();
+    const ct::StepStats& stats = automaton.stats();
+    imbalance += stats.imbalance;
+    auto wall = std::max<double>(stats.wall.count(), 1);
+    for (auto wait : stats.wait) {
+      wait_share += wait.count() / wall / stats.wait.size();
+    }
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return {static_cast<double>(cells) * generations / elapsed.count(), imbalance / generations, wait_share / generations};
+}
+
+template <typename State, size_t D>
+void sweep(const std::string& name, const std::array<size_t, D>& extents, size_t max_threads, size_t generations) {
+  std::string shape;
+  for (size_t dim = 0; dim < D; ++dim) {
+    shape += (dim ? "x" : "") + std::to_string(extents[dim]);
+  }
+  double single = 0;
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    Sample sample = measure<State>(extents, threads, generations);
+    if (threads == 1) {
+      single = sample.cells_per_second;
+    }
+    std::cout << std::left << std::setw(4) << D << std::setw(16) << shape << std::setw(8) << name << std::right
+              << std::setw(4) << threads << std::setw(14) << std::scientific << std::setprecision(3)
+              << sample.cells_per_second << std::fixed << std::setw(10) << std::setprecision(2)
+              << sample.cells_per_second / single / threads << std::setw(10) << sample.imbalance << std::setw(10)
+              << sample.wait_share << "\n";
+  }
+}
+
+template <size_t D>
+void sweep_states(const std::array<size_t, D>& extents, size_t max_threads, size_t generations) {
+  sweep<std::uint8_t>("1B", extents, max_threads, generations);
+  sweep<std::uint32_t>("4B", extents, max_threads, generations);
+  sweep<Cell<16>>("16B", extents, max_threads, generations);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  size_t max_threads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : std::max(std::thread::hardware_concurrency(), 1u);
+  size_t generations = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 20;
+  std::cout << std::left << std::setw(4) << "D" << std::setw(16) << "extents" << std::setw(8) << "state" << std::right
+            << std::setw(4) << "thr" << std::setw(14) << "cells/s" << std::setw(10) << "scaling" << std::setw(10)
+            << "imbalance" << std::setw(10) << "wait" << "\n";
+  sweep_states<1>({1 << 16}, max_threads, generations);
+  sweep_states<1>({1 << 22}, max_threads, generations);
+  sweep_states<2>({256, 256}, max_threads, generations);
+  sweep_states<2>({2048, 2048}, max_threads, generations);
+  sweep_states<3>({32, 32, 32}, max_threads, generations);
+  sweep_states<3>({160, 160, 160}, max_threads, generations);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace ct::detail {
+// Change flags for tiles of whole outermost-dimension rows. A tile is at least `radius` rows high, so a cell
+// only depends on its own tile and the two adjacent ones (the grid is treated as wrapping around)
+class ActiveTiles {
+public:
+  static constexpr size_t tile_cells = 256;
+
+  ActiveTiles(size_t rows, size_t row_cells, size_t radius)
+      : rows(rows)
+      , tile_rows(std::max({radius, size_t{1}, row_cells ? (tile_cells + row_cells - 1) / row_cells : 1}))
+      , changed(std::max<size_t>(rows / tile_rows, 1))
+      , next_changed(changed.size()) {}
+
+  size_t size() const noexcept {
+    return changed.size();
+  }
+
+  // the last tile also takes the remainder rows
+  size_t first_row(size_t tile) const noexcept {
+    return tile == size() ? rows : tile * tile_rows;
+  }
+
+  bool active(size_t tile) const noexcept {
+    size_t tiles = size();
+    return all_dirty || changed[tile] || changed[(tile + 1) % tiles] || changed[(tile + tiles - 1) % tiles];
+  }
+
+  void mark(size_t tile, bool tile_changed) noexcept {
+    next_changed[tile] = tile_changed;
+  }
+
+  void advance() noexcept {
+    changed.swap(next_changed);
+    all_dirty = false;
+  }
+
+  // the grid was modified outside of a step, nothing is known about the previous generation anymore
+  void invalidate() noexcept {
+    all_dirty = true;
+  }
+
+  // a cell of `row` was modified outside of a step: its tile and the adjacent ones are recomputed by the next one
+  void touch(size_t row) noexcept {
+    changed[std::min(row / tile_rows, size() - 1)] = true;
+  }
+
+private:
+  size_t rows;
+  size_t tile_rows;
+  std::vector<unsigned char> changed;
+  std::vector<unsigned char> next_changed;
+  bool all_dirty = true;
+};
+} // namespace ct::detail
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+
+namespace ct {
+// How neighbours outside of the grid are seen by an engine that owns the boundary handling: as a fixed state,
+// as the cells of the opposite side, or as the cells mirrored by the edge (cell -1 is cell 0)
+enum class Boundary {
+  fixed,
+  toroidal,
+  reflect,
+};
+
+namespace detail {
+// The cell inside [0, size) seen at `coordinate` under a wrapping boundary, size > 0
+constexpr size_t boundary_coordinate(Boundary boundary, std::ptrdiff_t coordinate, size_t size) noexcept {
+  auto period = static_cast<std::ptrdiff_t>(boundary == Boundary::reflect ? 2 * size : size);
+  auto position = static_cast<size_t>((coordinate % period + period) % period);
+  return position < size ? position : 2 * size - 1 - position;
+}
+
+// Rules may choose the boundary with `static constexpr Boundary boundary`, it is toroidal otherwise
+template <typename Rule>
+constexpr Boundary rule_boundary() noexcept {
+  if constexpr (requires { Rule::boundary; }) {
+    return Rule::boundary;
+  } else {
+    return Boundary::toroidal;
+  }
+}
+} // namespace detail
+} // namespace ct
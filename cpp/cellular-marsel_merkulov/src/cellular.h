@@ -1,23 +1,28 @@
 #pragma once
 
+#include "activity.h"
 #include "multi-array.h"
+#include "stencil.h"
+#include "worker-pool.h"
 
 #include <algorithm>
 #include <array>
-#include <condition_variable>
 #include <functional>
-#include <thread>
+#include <limits>
+#include <utility>
+#include <variant>
+#include <vector>
 
 namespace ct {
 
-template <typename State, size_t D>
+template <typename State, size_t D, typename Layout>
 class GridView;
 
-template <typename State, size_t D = 2>
+template <typename State, size_t D = 2, typename Layout = RowMajor>
 class GridView {
-  using Data = detail::MultiArr<std::remove_cv_t<State>, D>;
+  using Data = detail::MultiArr<std::remove_cv_t<State>, D, Layout>;
 
-  template <typename U, size_t N>
+  template <typename U, size_t N, typename L>
   friend class GridView;
 
 public:
@@ -26,7 +31,7 @@ public:
 
   template <typename U>
     requires (std::is_same_v<U, std::remove_cv_t<State>> && std::is_const_v<State>)
-  GridView(const GridView<U, D>& other)
+  GridView(const GridView<U, D, Layout>& other)
       : data(other.data) {}
 
   size_t extent(size_t dim) const {
@@ -48,115 +53,382 @@ private:
 };
 
 namespace detail {
-template <typename State, size_t D, typename Rule>
+template <typename State, size_t D, typename Rule, typename Layout = RowMajor>
 concept Rules = []<size_t... Is>(std::index_sequence<Is...>) {
-  return requires (Rule rule, const GridView<const State, D> grid) {
+  return requires (Rule rule, const GridView<const State, D, Layout> grid) {
     { std::invoke(rule, grid, Is...) } -> std::convertible_to<State>;
   };
 }(std::make_index_sequence<D>{});
+
+// A local rule promises that the new state of a cell is a deterministic function of the cells
+// at most `Rule::radius` away from it along every dimension; stencil rules are local by construction
+template <typename Rule>
+concept LocalRules = requires {
+  { Rule::radius } -> std::convertible_to<size_t>;
+} || requires { typename Rule::neighbourhood; };
+
+// Rules that read past the edges of the grid may ask for `static constexpr size_t ghost_width` ghost cells around
+// it, refreshed before every step according to `rule_boundary<Rule>()` (`rule.ghost_value` or a
+// default-constructed state for `Boundary::fixed`)
+template <typename Rule>
+constexpr size_t ghost_width() noexcept {
+  if constexpr (requires { Rule::ghost_width; }) {
+    return Rule::ghost_width;
+  } else {
+    return 0;
+  }
+}
+
+template <typename Rule>
+constexpr size_t rule_radius() noexcept {
+  if constexpr (requires { typename Rule::neighbourhood; }) {
+    return Rule::neighbourhood::radius;
+  } else {
+    return Rule::radius;
+  }
+}
 } // namespace detail
 
-template <typename State, typename Rule, size_t D = 2>
-  requires detail::Rules<State, D, Rule>
+// Completes an asynchronous step when waited for or destroyed; must not outlive its automaton
+template <typename Automaton>
+class StepHandle {
+public:
+  StepHandle(StepHandle&& other) noexcept
+      : automaton(std::exchange(other.automaton, nullptr))
+      , ticket(other.ticket) {}
+
+  StepHandle& operator=(StepHandle&& other) noexcept {
+    if (this != &other) {
+      wait();
+      automaton = std::exchange(other.automaton, nullptr);
+      ticket = other.ticket;
+    }
+    return *this;
+  }
+
+  ~StepHandle() {
+    wait();
+  }
+
+  bool ready() const noexcept {
+    return !automaton || automaton->pool.done(ticket);
+  }
+
+  void wait() noexcept {
+    if (Automaton* finished = std::exchange(automaton, nullptr); finished && finished->pool.last(ticket)) {
+      finished->finish_step();
+    }
+  }
+
+private:
+  friend Automaton;
+
+  StepHandle(Automaton& automaton, size_t ticket) noexcept
+      : automaton(&automaton)
+      , ticket(ticket) {}
+
+  Automaton* automaton;
+  size_t ticket;
+};
+
+template <typename State, typename Rule, size_t D = 2, typename Layout = RowMajor>
+  requires detail::Rules<State, D, Rule, Layout> || detail::StencilRules<std::remove_cv_t<State>, D, Rule>
 class CellularAutomaton {
-  using Data = detail::MultiArr<std::remove_cv_t<State>, D>;
-  using View = GridView<State, D>;
-  using ConstView = GridView<const State, D>;
+  using Data = detail::MultiArr<std::remove_cv_t<State>, D, Layout>;
+  using View = GridView<State, D, Layout>;
+  using ConstView = GridView<const State, D, Layout>;
   using IndexArray = std::array<size_t, D>;
 
+  static constexpr size_t ghost_width = detail::ghost_width<Rule>();
+
+  static constexpr bool tracks_activity = detail::LocalRules<Rule> && std::equality_comparable<State>;
+  using Activity = std::conditional_t<tracks_activity, detail::ActiveTiles, std::monostate>;
+
+  static constexpr bool is_stencil = detail::StencilRules<std::remove_cv_t<State>, D, Rule>;
+  using Stencil =
+      std::conditional_t<is_stencil, detail::StencilEvaluator<std::remove_cv_t<State>, D, Rule, Layout>, std::monostate>;
+
 public:
   CellularAutomaton(const IndexArray& extents, size_t n_threads, Rule rule = {})
-      : data(extents)
-      , step_new_data(extents)
+      : data(extents, ghost_width)
+      , step_new_data(extents, ghost_width)
       , rule(std::move(rule))
-      , n_threads(n_threads)
-      , threads_done(n_threads, false) {
-    threads.reserve(n_threads);
-    for (size_t thread_id = 0; thread_id < n_threads; ++thread_id) {
-      threads.emplace_back([this, thread_id, n_threads](std::stop_token token) {
-        while (true) {
-          std::unique_lock lock(mutex);
-          start_cv.wait(lock, token, [this, thread_id]() {
-            return step_in_progress && !threads_done[thread_id];
-          });
-
-          if (token.stop_requested()) {
-            return;
-          }
-          lock.unlock();
-          size_t thread_count = (data.data.size() + n_threads - 1) / n_threads;
-          size_t thread_end = std::min(data.data.size(), thread_count * (thread_id + 1));
-          for (size_t i = thread_count * thread_id; i < thread_end; ++i) {
-            IndexArray indices = data.from_primary(i);
-            step_new_data.data[i] = rule_call(indices, std::make_index_sequence<D>());
-          }
-          lock.lock();
-          threads_done[thread_id] = true;
-          threads_completed++;
-
-          if (threads_completed == n_threads) {
-            step_in_progress = false;
-            lock.unlock();
-            done_cv.notify_one();
-          } else {
-            lock.unlock();
-          }
-        }
-      });
-    }
-  }
+      , activity(make_activity(data))
+      , stencil(make_stencil(data))
+      , tile_rows(make_tile_rows(data))
+      , scheduler(std::max<size_t>(n_threads, 1))
+      , pool(n_threads) {}
 
   CellularAutomaton(const CellularAutomaton&) = delete;
   CellularAutomaton& operator=(const CellularAutomaton&) = delete;
 
-  GridView<State, D> grid() noexcept {
+  // the current generation; the grid is modified through `edit()` or `set()`
+  ConstView grid() noexcept {
+    finish_step();
+    return ConstView(data);
+  }
+
+  ConstView grid() const noexcept {
+    return ConstView(const_cast<Data&>(data));
+  }
+
+  // with activity tracking the returned view should not be kept across steps: writes through it are only
+  // noticed by the step following the call, which recomputes the whole grid
+  View edit() noexcept {
+    finish_step();
+    if constexpr (tracks_activity) {
+      activity.invalidate();
+    }
     return View(data);
   }
 
-  GridView<const State, D> grid() const noexcept {
-    return ConstView(data);
+  // with activity tracking only the neighbourhood of the cell is recomputed by the next step
+  void set(const IndexArray& indices, std::remove_cv_t<State> state) {
+    finish_step();
+    if constexpr (tracks_activity) {
+      activity.touch(indices[0]);
+    }
+    data[indices] = std::move(state);
   }
 
   void step() {
-    std::unique_lock lock(mutex);
-    threads_completed = 0;
-    std::fill(threads_done.begin(), threads_done.end(), false);
-    step_in_progress = true;
-    lock.unlock();
-    start_cv.notify_all();
-    lock.lock();
-    done_cv.wait(lock, [this]() {
-      return !step_in_progress;
-    });
-    data.data.swap(step_new_data.data);
+    step_async().wait();
   }
 
-  ~CellularAutomaton() {
-    for (auto& thread : threads) {
-      thread.request_stop();
+  // Starts the next generation and returns at once; until the handle is waited for, the previous generation can
+  // be read through the const `grid()`. Any other call completes the pending step first
+  StepHandle<CellularAutomaton> step_async() {
+    finish_step();
+    if constexpr (ghost_width > 0) {
+      data.fill_ghosts(detail::rule_boundary<Rule>(), ghost_value());
+    }
+    if constexpr (tracks_activity) {
+      scheduler.reset(activity.size());
+    } else {
+      scheduler.reset((data.sizes[0] + tile_rows - 1) / tile_rows);
+    }
+    return StepHandle<CellularAutomaton>(*this, pool.start(step_job));
+  }
+
+  // timings of the last completed parallel job: a generation, or a block of generations in `step(generations)`
+  const StepStats& stats() const noexcept {
+    return pool.stats();
+  }
+
+  // ghost cells of the private buffers are not maintained, so rules with ghost cells are not blocked
+  void step(size_t generations) {
+    finish_step();
+    if constexpr (detail::LocalRules<Rule> && ghost_width == 0) {
+      size_t depth = block_depth();
+      if (depth > 1 && generations > 1 && scratch.empty()) {
+        make_scratch(depth);
+      }
+      while (depth > 1 && generations > 1) {
+        size_t block = std::min(generations, depth);
+        auto job = [this, block](size_t worker_id) {
+          compute_block(worker_id, block);
+        };
+        pool.run(job);
+        data.data.swap(step_new_data.data);
+        generations -= block;
+        if constexpr (tracks_activity) {
+          activity.invalidate();
+        }
+      }
+    }
+    for (; generations > 0; --generations) {
+      step();
     }
-    start_cv.notify_all();
   }
 
 private:
+  friend class StepHandle<CellularAutomaton>;
+
+  struct StepJob {
+    CellularAutomaton* automaton;
+
+    void operator()(size_t worker_id) const {
+      if constexpr (tracks_activity) {
+        automaton->compute_active(worker_id);
+      } else {
+        automaton->compute(worker_id);
+      }
+    }
+  };
+
+  void finish_step() noexcept {
+    if (!pool.finish()) {
+      return;
+    }
+    if constexpr (tracks_activity) {
+      activity.advance();
+    }
+    data.data.swap(step_new_data.data);
+  }
+
+  static Activity make_activity(const Data& data) {
+    if constexpr (tracks_activity) {
+      size_t rows = data.sizes[0];
+      return detail::ActiveTiles(rows, rows ? data.cells() / rows : 0, detail::rule_radius<Rule>());
+    } else {
+      return {};
+    }
+  }
+
+  static Stencil make_stencil(const Data& data) {
+    if constexpr (is_stencil) {
+      return Stencil(data);
+    } else {
+      return {};
+    }
+  }
+
+  std::remove_cv_t<State> ghost_value() const {
+    if constexpr (requires { rule.ghost_value; }) {
+      return rule.ghost_value;
+    } else {
+      return {};
+    }
+  }
+
+  size_t first_row(size_t worker_id) const noexcept {
+    return data.sizes[0] * worker_id / pool.size();
+  }
+
+  // Tiles of whole rows with at least `ActiveTiles::tile_cells` cells, the unit of work stealing when activity
+  // is not tracked
+  static size_t make_tile_rows(const Data& data) {
+    size_t rows = data.sizes[0];
+    size_t row_cells = rows ? data.cells() / rows : 0;
+    size_t tile_cells = detail::ActiveTiles::tile_cells;
+    return row_cells ? (tile_cells + row_cells - 1) / row_cells : 1;
+  }
+
+  void compute(size_t worker_id) {
+    size_t rows = data.sizes[0];
+    for (size_t tile; (tile = scheduler.next(worker_id)) != detail::TileScheduler::none;) {
+      size_t first = tile * tile_rows;
+      compute_rows(data, step_new_data, first, std::min(rows, first + tile_rows) - first);
+    }
+  }
+
+  // Recomputes only the tiles next to a change of the previous generation; a skipped tile was unchanged, so the
+  // target buffer, which holds the previous generation, already has its current state
+  void compute_active(size_t worker_id) {
+    for (size_t tile; (tile = scheduler.next(worker_id)) != detail::TileScheduler::none;) {
+      if (!activity.active(tile)) {
+        activity.mark(tile, false);
+        continue;
+      }
+      bool changed = false;
+      evaluate(data, activity.first_row(tile), activity.first_row(tile + 1), [this, &changed](size_t index, State state) {
+        changed |= !(state == data.data[index]);
+        step_new_data.data[index] = std::move(state);
+      });
+      activity.mark(tile, changed);
+    }
+  }
+
+  // Rows of the source wrap around, so a block may start near the end of the grid and continue from its start
+  void compute_rows(Data& source, Data& target, size_t first, size_t count) {
+    auto update = [&target](size_t index, State state) {
+      target.data[index] = std::move(state);
+    };
+    size_t rows = data.sizes[0];
+    size_t last = std::min(rows, first + count);
+    evaluate(source, first, last, update);
+    evaluate(source, 0, first + count - last, update);
+  }
+
+  // Calls `visit(index, state)` with the new state of every cell whose outermost index lies in [first, last)
+  template <typename Visit>
+  void evaluate(Data& source, size_t first, size_t last, Visit&& visit) {
+    if constexpr (is_stencil) {
+      stencil.evaluate(rule, source, first, last, visit);
+    } else {
+      source.for_each_index(first, last, [this, &source, &visit](const IndexArray& indices, size_t index) {
+        visit(index, rule_call(source, indices, std::make_index_sequence<D>()));
+      });
+    }
+  }
+
+  // Number of generations a worker may advance its rows on its own: the halo of `radius` rows per
+  // generation must not wrap around onto the worker's own rows, and recomputing it should stay within
+  // a quarter of the rows themselves
+  size_t block_depth() const noexcept {
+    size_t rows = data.sizes[0];
+    size_t tile = (rows + pool.size() - 1) / pool.size();
+    size_t radius = detail::rule_radius<Rule>();
+    if (radius == 0) {
+      return std::numeric_limits<size_t>::max();
+    }
+    return std::min((rows - tile) / (2 * radius), std::max<size_t>(tile / (4 * radius), 2));
+  }
+
+  // Two private buffers per worker, each holding only the worker's rows and a halo of `radius * depth` rows on
+  // both sides
+  void make_scratch(size_t depth) {
+    size_t rows = data.sizes[0];
+    size_t halo = detail::rule_radius<Rule>() * depth;
+    scratch.reserve(2 * pool.size());
+    for (size_t worker_id = 0; worker_id < pool.size(); ++worker_id) {
+      size_t first = first_row(worker_id);
+      size_t count = first_row(worker_id + 1) - first;
+      size_t origin = (first + rows - halo) % rows;
+      for (size_t i = 0; i < 2; ++i) {
+        scratch.emplace_back(data.sizes, origin, count ? count + 2 * halo : 0);
+      }
+    }
+  }
+
+  // Advances the worker's rows by `generations` in its private buffers, recomputing a halo that shrinks by
+  // `radius` rows per generation. Only the rows the worker reads and writes are copied in and out of them
+  void compute_block(size_t worker_id, size_t generations) {
+    size_t first = first_row(worker_id);
+    size_t count = first_row(worker_id + 1) - first;
+    if (count == 0) {
+      return;
+    }
+    size_t rows = data.sizes[0];
+    size_t halo = detail::rule_radius<Rule>() * generations;
+    Data* source = &scratch[2 * worker_id];
+    copy_rows(data, *source, (first + rows - halo) % rows, count + 2 * halo);
+    for (size_t generation = 1; generation <= generations; ++generation) {
+      halo = detail::rule_radius<Rule>() * (generations - generation);
+      Data* target = &scratch[2 * worker_id + generation % 2];
+      compute_rows(*source, *target, (first + rows - halo) % rows, count + 2 * halo);
+      source = target;
+    }
+    copy_rows(*source, step_new_data, first, count);
+  }
+
+  // Rows wrap around as in `compute_rows`; both grids must store all of them
+  static void copy_rows(const Data& source, Data& target, size_t first, size_t count) {
+    auto copy = [&source, &target](const IndexArray& indices, size_t index, size_t length) {
+      std::copy_n(source.data.begin() + source.to_primary(indices), length, target.data.begin() + index);
+    };
+    size_t rows = source.sizes[0];
+    size_t last = std::min(rows, first + count);
+    target.for_each_row(first, last, copy);
+    target.for_each_row(0, first + count - last, copy);
+  }
+
   template <size_t... Indices>
     requires (sizeof...(Indices) == D)
-  State rule_call(const IndexArray& indices, std::index_sequence<Indices...>) {
-    return std::invoke(rule, View(data), indices[Indices]...);
+  State rule_call(Data& source, const IndexArray& indices, std::index_sequence<Indices...>) {
+    return std::invoke(rule, ConstView(source), indices[Indices]...);
   }
 
-  std::vector<std::jthread> threads;
   Data data;
   Data step_new_data;
   Rule rule;
-  size_t n_threads;
-
-  std::vector<bool> threads_done;
-  size_t threads_completed = 0;
-  bool step_in_progress = false;
-  std::condition_variable_any start_cv;
-  std::condition_variable done_cv;
-  std::mutex mutex;
+  [[no_unique_address]] Activity activity;
+  [[no_unique_address]] Stencil stencil;
+  std::vector<Data> scratch;
+  size_t tile_rows;
+  detail::TileScheduler scheduler;
+  StepJob step_job{this};
+  detail::StepPool pool;
 };
 
 } // namespace ct
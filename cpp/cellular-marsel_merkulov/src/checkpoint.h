@@ -0,0 +1,444 @@
+#pragma once
+
+#include "cellular.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ct {
+// Checkpoint files start with a header followed by the cells in row-major order: raw states, or bits packed
+// 8 per byte (lowest bit first) for bool. Stream files have the same header followed by frames, every frame
+// holding the XOR of its cells with the previous frame's, run-length encoded
+namespace detail {
+struct CheckpointHeader {
+  static constexpr char signature[8] = {'C', 'T', 'G', 'R', 'I', 'D', '\0', '\1'};
+  static constexpr std::uint32_t packed_flag = 1;
+  static constexpr std::uint32_t stream_flag = 2;
+
+  char magic[8];
+  std::uint32_t dimensions;
+  std::uint32_t state_size;
+  std::uint32_t flags;
+  std::uint32_t reserved;
+  std::uint64_t generation;
+};
+
+struct FrameHeader {
+  std::uint64_t generation;
+  std::uint64_t size;
+};
+
+template <typename State>
+constexpr bool packed_cells = std::is_same_v<State, bool>;
+
+template <typename State, size_t D>
+std::vector<std::byte> make_header(const std::array<size_t, D>& extents, std::uint32_t flags, std::uint64_t generation) {
+  CheckpointHeader header{};
+  std::memcpy(header.magic, CheckpointHeader::signature, sizeof(header.magic));
+  header.dimensions = D;
+  header.state_size = sizeof(State);
+  header.flags = flags | (packed_cells<State> ? CheckpointHeader::packed_flag : 0);
+  header.generation = generation;
+  std::vector<std::byte> bytes(sizeof(header) + D * sizeof(std::uint64_t));
+  std::memcpy(bytes.data(), &header, sizeof(header));
+  for (size_t dim = 0; dim < D; ++dim) {
+    auto extent = static_cast<std::uint64_t>(extents[dim]);
+    std::memcpy(bytes.data() + sizeof(header) + dim * sizeof(extent), &extent, sizeof(extent));
+  }
+  return bytes;
+}
+
+template <typename State, size_t D>
+size_t payload_size(const std::array<size_t, D>& extents) noexcept {
+  size_t cells = 1;
+  for (size_t extent : extents) {
+    cells *= extent;
+  }
+  return packed_cells<State> ? (cells + 7) / 8 : cells * sizeof(State);
+}
+
+// Calls `function(indices, cell)` for every cell in row-major order
+template <size_t D, typename Function>
+void for_each_cell(const std::array<size_t, D>& extents, Function&& function) {
+  size_t cells = 1;
+  for (size_t extent : extents) {
+    cells *= extent;
+  }
+  std::array<size_t, D> indices{};
+  for (size_t cell = 0; cell < cells; ++cell) {
+    function(std::as_const(indices), cell);
+    for (size_t dim = D; dim-- > 0;) {
+      if (++indices[dim] < extents[dim]) {
+        break;
+      }
+      indices[dim] = 0;
+    }
+  }
+}
+
+template <typename State, size_t D, typename Grid>
+void pack(const Grid& grid, const std::array<size_t, D>& extents, std::byte* payload) {
+  if constexpr (packed_cells<State>) {
+    std::memset(payload, 0, payload_size<State>(extents));
+    for_each_cell(extents, [&grid, payload](const std::array<size_t, D>& indices, size_t cell) {
+      if (grid[indices]) {
+        payload[cell / 8] |= std::byte{1} << (cell % 8);
+      }
+    });
+  } else {
+    for_each_cell(extents, [&grid, payload](const std::array<size_t, D>& indices, size_t cell) {
+      const State& state = grid[indices];
+      std::memcpy(payload + cell * sizeof(State), &state, sizeof(State));
+    });
+  }
+}
+
+template <typename State, size_t D, typename Grid>
+void unpack(const std::byte* payload, const std::array<size_t, D>& extents, const Grid& grid) {
+  for_each_cell(extents, [&grid, payload](const std::array<size_t, D>& indices, size_t cell) {
+    if constexpr (packed_cells<State>) {
+      grid[indices] = ((payload[cell / 8] >> (cell % 8)) & std::byte{1}) != std::byte{0};
+    } else {
+      State state;
+      std::memcpy(&state, payload + cell * sizeof(State), sizeof(State));
+      grid[indices] = state;
+    }
+  });
+}
+
+template <size_t D, typename Grid>
+std::array<size_t, D> extents_of(const Grid& grid) {
+  std::array<size_t, D> extents;
+  for (size_t dim = 0; dim < D; ++dim) {
+    extents[dim] = grid.extent(dim);
+  }
+  return extents;
+}
+
+// Read-only mapping of a whole file
+class MappedFile {
+public:
+  explicit MappedFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::system_error(errno, std::generic_category(), "cannot open " + path);
+    }
+    struct stat st{};
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      void* address = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (address != MAP_FAILED) {
+        ::madvise(address, st.st_size, MADV_SEQUENTIAL);
+        bytes = static_cast<const std::byte*>(address);
+        length = st.st_size;
+      }
+    }
+    ::close(fd);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() {
+    if (bytes) {
+      ::munmap(const_cast<std::byte*>(bytes), length);
+    }
+  }
+
+  const std::byte* data() const noexcept {
+    return bytes;
+  }
+
+  size_t size() const noexcept {
+    return length;
+  }
+
+private:
+  const std::byte* bytes = nullptr;
+  size_t length = 0;
+};
+
+// Checks that the file was written for the grid and returns its header
+template <typename State, size_t D>
+CheckpointHeader read_header(const MappedFile& file, const std::array<size_t, D>& extents, std::uint32_t flags) {
+  std::vector<std::byte> expected = make_header<State>(extents, flags, 0);
+  CheckpointHeader header;
+  if (file.size() < expected.size()) {
+    throw std::invalid_argument("not a grid checkpoint");
+  }
+  std::memcpy(&header, file.data(), sizeof(header));
+  if (std::memcmp(file.data(), expected.data(), offsetof(CheckpointHeader, generation)) != 0 ||
+      std::memcmp(file.data() + sizeof(header), expected.data() + sizeof(header), expected.size() - sizeof(header)) != 0) {
+    throw std::invalid_argument("checkpoint does not match the grid");
+  }
+  return header;
+}
+
+inline void write_all(std::ofstream& out, const std::byte* bytes, size_t size) {
+  out.write(reinterpret_cast<const char*>(bytes), static_cast<std::streamsize>(size));
+}
+
+// Runs of zero bytes and of literal bytes, as pairs of 32-bit lengths followed by the literals
+inline void encode_delta(const std::byte* delta, size_t size, std::vector<std::byte>& out) {
+  out.clear();
+  auto put = [&out](std::uint32_t value) {
+    std::byte bytes[sizeof(value)];
+    std::memcpy(bytes, &value, sizeof(value));
+    out.insert(out.end(), bytes, bytes + sizeof(value));
+  };
+  constexpr size_t max_run = 0xffffffff;
+  for (size_t i = 0; i < size;) {
+    size_t zeros = i;
+    while (zeros < size && zeros - i < max_run && delta[zeros] == std::byte{0}) {
+      ++zeros;
+    }
+    // a literal run ends at the first pair of zero bytes
+    size_t literals = zeros;
+    while (literals < size && literals - zeros < max_run &&
+           !(delta[literals] == std::byte{0} && (literals + 1 == size || delta[literals + 1] == std::byte{0}))) {
+      ++literals;
+    }
+    put(static_cast<std::uint32_t>(zeros - i));
+    put(static_cast<std::uint32_t>(literals - zeros));
+    out.insert(out.end(), delta + zeros, delta + literals);
+    i = literals;
+  }
+}
+
+// XORs the decoded delta into `cells`; false if the encoding is malformed
+inline bool apply_delta(const std::byte* encoded, size_t size, std::byte* cells, size_t cells_size) {
+  size_t position = 0;
+  for (size_t i = 0; i < size;) {
+    std::uint32_t runs[2];
+    if (size - i < sizeof(runs)) {
+      return false;
+    }
+    std::memcpy(runs, encoded + i, sizeof(runs));
+    i += sizeof(runs);
+    position += runs[0];
+    if (runs[1] > size - i || position > cells_size || runs[1] > cells_size - position) {
+      return false;
+    }
+    for (std::uint32_t k = 0; k < runs[1]; ++k) {
+      cells[position++] ^= encoded[i++];
+    }
+  }
+  return position <= cells_size;
+}
+} // namespace detail
+
+// Writes the automaton's grid; throws std::system_error when the file cannot be written
+template <typename State, typename Rule, size_t D, typename Layout>
+void save_checkpoint(
+    const std::string& path,
+    const CellularAutomaton<State, Rule, D, Layout>& automaton,
+    std::uint64_t generation
+) {
+  static_assert(std::is_trivially_copyable_v<State>, "checkpoints store the states as raw bytes");
+  auto grid = automaton.grid();
+  auto extents = detail::extents_of<D>(grid);
+  std::vector<std::byte> bytes = detail::make_header<State>(extents, 0, generation);
+  size_t header_size = bytes.size();
+  bytes.resize(header_size + detail::payload_size<State>(extents));
+  detail::pack<State>(grid, extents, bytes.data() + header_size);
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  detail::write_all(out, bytes.data(), bytes.size());
+  if (!out.flush()) {
+    throw std::system_error(errno, std::generic_category(), "cannot write " + path);
+  }
+}
+
+// Restores a grid saved by `save_checkpoint` from a mapping of the file (a single copy into the grid, the
+// storage of which is owned by the automaton) and returns its generation
+template <typename State, typename Rule, size_t D, typename Layout>
+std::uint64_t load_checkpoint(const std::string& path, CellularAutomaton<State, Rule, D, Layout>& automaton) {
+  auto grid = automaton.edit();
+  auto extents = detail::extents_of<D>(grid);
+  detail::MappedFile file(path);
+  detail::CheckpointHeader header = detail::read_header<State>(file, extents, 0);
+  size_t header_size = sizeof(header) + D * sizeof(std::uint64_t);
+  if (file.size() != header_size + detail::payload_size<State>(extents)) {
+    throw std::invalid_argument("truncated checkpoint");
+  }
+  detail::unpack<State>(file.data() + header_size, extents, grid);
+  return header.generation;
+}
+
+// Appends every `period`-th generation to a stream file. `push` only copies the cells, the delta encoding and
+// the writing are done by a background thread; `push` waits only if the previous frame is still being written.
+// The background thread stops at the first failed write, and `push` and `flush` then throw std::system_error
+template <typename State, size_t D>
+class CheckpointStream {
+  static_assert(std::is_trivially_copyable_v<State>, "checkpoints store the states as raw bytes");
+
+public:
+  CheckpointStream(const std::string& path, const std::array<size_t, D>& extents, std::uint64_t period = 1)
+      : path(path)
+      , extents(extents)
+      , period(std::max<std::uint64_t>(period, 1))
+      , out(path, std::ios::binary | std::ios::trunc)
+      , staged(detail::payload_size<State>(extents))
+      , previous(staged.size()) {
+    std::vector<std::byte> header = detail::make_header<State>(extents, detail::CheckpointHeader::stream_flag, 0);
+    detail::write_all(out, header.data(), header.size());
+    if (!out.flush()) {
+      throw std::system_error(errno, std::generic_category(), "cannot write " + path);
+    }
+    writer = std::jthread([this](std::stop_token token) {
+      write_frames(token);
+    });
+  }
+
+  CheckpointStream(const CheckpointStream&) = delete;
+  CheckpointStream& operator=(const CheckpointStream&) = delete;
+
+  // a write error not reported yet is lost
+  ~CheckpointStream() {
+    std::unique_lock lock(mutex);
+    wait_written(lock);
+    lock.unlock();
+    writer.request_stop();
+  }
+
+  template <typename Rule, typename Layout>
+  void push(const CellularAutomaton<State, Rule, D, Layout>& automaton, std::uint64_t generation) {
+    if (generation % period != 0) {
+      return;
+    }
+    std::unique_lock lock(mutex);
+    ready.wait(lock, [this] {
+      return !has_frame || error;
+    });
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    detail::pack<State>(automaton.grid(), extents, staged.data());
+    staged_generation = generation;
+    has_frame = true;
+    ready.notify_all();
+  }
+
+  // waits until all pushed frames are written
+  void flush() {
+    std::unique_lock lock(mutex);
+    wait_written(lock);
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+private:
+  void wait_written(std::unique_lock<std::mutex>& lock) {
+    ready.wait(lock, [this] {
+      return (!has_frame && !writing) || error;
+    });
+  }
+
+  void write_frames(std::stop_token token) {
+    std::vector<std::byte> delta(staged.size());
+    std::vector<std::byte> encoded;
+    while (true) {
+      std::uint64_t generation;
+      {
+        std::unique_lock lock(mutex);
+        if (!ready.wait(lock, token, [this] {
+              return has_frame;
+            })) {
+          return;
+        }
+        for (size_t i = 0; i < staged.size(); ++i) {
+          delta[i] = staged[i] ^ previous[i];
+        }
+        previous.swap(staged);
+        generation = staged_generation;
+        has_frame = false;
+        writing = true;
+        ready.notify_all();
+      }
+      detail::encode_delta(delta.data(), delta.size(), encoded);
+      detail::FrameHeader frame{generation, encoded.size()};
+      detail::write_all(out, reinterpret_cast<const std::byte*>(&frame), sizeof(frame));
+      detail::write_all(out, encoded.data(), encoded.size());
+      bool failed = !out.flush();
+      std::lock_guard lock(mutex);
+      writing = false;
+      if (failed) {
+        error = std::make_exception_ptr(std::system_error(errno, std::generic_category(), "cannot write " + path));
+      }
+      ready.notify_all();
+      if (failed) {
+        return;
+      }
+    }
+  }
+
+  std::string path;
+  std::array<size_t, D> extents;
+  std::uint64_t period;
+  std::ofstream out;
+  std::vector<std::byte> staged;
+  std::vector<std::byte> previous;
+  std::uint64_t staged_generation = 0;
+  bool has_frame = false;
+  bool writing = false;
+  std::exception_ptr error;
+  std::mutex mutex;
+  std::condition_variable_any ready;
+  std::jthread writer;
+};
+
+// Restores the last complete frame of a stream file, ignoring a frame cut short by a crash, and returns its
+// generation; throws std::invalid_argument if there is no complete frame
+template <typename State, typename Rule, size_t D, typename Layout>
+std::uint64_t load_stream(const std::string& path, CellularAutomaton<State, Rule, D, Layout>& automaton) {
+  auto grid = automaton.edit();
+  auto extents = detail::extents_of<D>(grid);
+  detail::MappedFile file(path);
+  detail::read_header<State>(file, extents, detail::CheckpointHeader::stream_flag);
+  std::vector<std::byte> cells(detail::payload_size<State>(extents));
+  std::vector<std::byte> next = cells;
+  size_t position = sizeof(detail::CheckpointHeader) + D * sizeof(std::uint64_t);
+  bool restored = false;
+  std::uint64_t generation = 0;
+  while (file.size() - position >= sizeof(detail::FrameHeader)) {
+    detail::FrameHeader frame;
+    std::memcpy(&frame, file.data() + position, sizeof(frame));
+    position += sizeof(frame);
+    if (frame.size > file.size() - position) {
+      break;
+    }
+    next = cells;
+    if (!detail::apply_delta(file.data() + position, frame.size, next.data(), next.size())) {
+      break;
+    }
+    cells.swap(next);
+    position += frame.size;
+    generation = frame.generation;
+    restored = true;
+  }
+  if (!restored) {
+    throw std::invalid_argument("stream has no complete frame");
+  }
+  detail::unpack<State>(cells.data(), extents, grid);
+  return generation;
+}
+} // namespace ct
@@ -0,0 +1,314 @@
+#pragma once
+
+#include "life.h"
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+namespace ct {
+
+// HashLife backend for LifeRule automata on the unbounded plane (the rule's boundary is ignored).
+// The plane is a quadtree of interned nodes, every node memoizes its centre advanced by each power of two
+// generations it was asked for, so regular patterns can be advanced exponentially far
+class HashLife {
+  static constexpr size_t no_successors = -1;
+
+  struct Node {
+    const Node* nw;
+    const Node* ne;
+    const Node* sw;
+    const Node* se;
+    unsigned level;
+    std::uint64_t population;
+    // first of the `level - 1` slots in `successors`, one per step
+    mutable size_t successors = no_successors;
+  };
+
+  struct NodeHash {
+    size_t operator()(const Node& node) const noexcept {
+      size_t hash = node.population;
+      for (const Node* child : {node.nw, node.ne, node.sw, node.se}) {
+        hash = hash * 0x9e3779b97f4a7c15 ^ std::hash<const Node*>()(child);
+      }
+      return hash;
+    }
+  };
+
+  struct NodeEqual {
+    bool operator()(const Node& lhs, const Node& rhs) const noexcept {
+      return lhs.nw == rhs.nw && lhs.ne == rhs.ne && lhs.sw == rhs.sw && lhs.se == rhs.se &&
+             lhs.population == rhs.population;
+    }
+  };
+
+public:
+  using Coordinate = std::int64_t;
+
+  class Window {
+  public:
+    BitGridView<const bool> grid() const noexcept {
+      return BitGridView<const bool>(const_cast<detail::BitGrid&>(data));
+    }
+
+  private:
+    friend class HashLife;
+
+    explicit Window(const std::array<size_t, 2>& extents)
+        : data(extents) {}
+
+    detail::BitGrid data;
+  };
+
+  explicit HashLife(LifeRule rule = LifeRule::conway())
+      : rule(rule) {
+    if (rule.born(0)) {
+      throw std::invalid_argument("rules with birth on 0 neighbours do not keep the plane empty");
+    }
+    dead = intern(nullptr, nullptr, nullptr, nullptr, 0, 0);
+    alive = intern(nullptr, nullptr, nullptr, nullptr, 0, 1);
+    root = empty(3);
+  }
+
+  HashLife(const HashLife&) = delete;
+  HashLife& operator=(const HashLife&) = delete;
+
+  // Copies the cells of a grid view, placing its cell (0, 0) at (x, y)
+  template <typename Grid>
+  void load(const Grid& grid, Coordinate x = 0, Coordinate y = 0) {
+    for (size_t i = 0; i < grid.extent(0); ++i) {
+      for (size_t j = 0; j < grid.extent(1); ++j) {
+        if (grid[i, j]) {
+          set(x + static_cast<Coordinate>(i), y + static_cast<Coordinate>(j), true);
+        }
+      }
+    }
+  }
+
+  bool get(Coordinate x, Coordinate y) const noexcept {
+    if (!contains(root, x, y)) {
+      return false;
+    }
+    const Node* node = root;
+    Coordinate half = half_size(root);
+    x += half;
+    y += half;
+    while (node->level > 0) {
+      half = Coordinate{1} << (node->level - 1);
+      node = quadrant(node, x >= half, y >= half);
+      x %= half;
+      y %= half;
+    }
+    return node == alive;
+  }
+
+  void set(Coordinate x, Coordinate y, bool value) {
+    while (!contains(root, x, y)) {
+      root = expand(root);
+    }
+    Coordinate half = half_size(root);
+    root = set(root, x + half, y + half, value);
+  }
+
+  void step(std::uint64_t generations) {
+    for (unsigned j = 0; generations >> j; ++j) {
+      if ((generations >> j) & 1) {
+        advance(j);
+      }
+    }
+    current_generation += generations;
+  }
+
+  std::uint64_t generation() const noexcept {
+    return current_generation;
+  }
+
+  std::uint64_t population() const noexcept {
+    return root->population;
+  }
+
+  // Materializes the cells in [x, x + extents[0]) x [y, y + extents[1])
+  Window window(Coordinate x, Coordinate y, const std::array<size_t, 2>& extents) const {
+    Window result(extents);
+    Coordinate half = half_size(root);
+    paint(result.data, root, -half - x, -half - y);
+    return result;
+  }
+
+private:
+  const Node* intern(const Node* nw, const Node* ne, const Node* sw, const Node* se, unsigned level, std::uint64_t population) {
+    return &*nodes.insert(Node{nw, ne, sw, se, level, population}).first;
+  }
+
+  const Node* join(const Node* nw, const Node* ne, const Node* sw, const Node* se) {
+    return intern(nw, ne, sw, se, nw->level + 1, nw->population + ne->population + sw->population + se->population);
+  }
+
+  const Node* empty(unsigned level) {
+    while (empty_nodes.size() <= level) {
+      if (empty_nodes.empty()) {
+        empty_nodes.push_back(dead);
+      } else {
+        const Node* child = empty_nodes.back();
+        empty_nodes.push_back(join(child, child, child, child));
+      }
+    }
+    return empty_nodes[level];
+  }
+
+  static Coordinate half_size(const Node* node) noexcept {
+    return Coordinate{1} << (node->level - 1);
+  }
+
+  static bool contains(const Node* node, Coordinate x, Coordinate y) noexcept {
+    Coordinate half = half_size(node);
+    return -half <= x && x < half && -half <= y && y < half;
+  }
+
+  static const Node* quadrant(const Node* node, bool south, bool east) noexcept {
+    return south ? (east ? node->se : node->sw) : (east ? node->ne : node->nw);
+  }
+
+  // `x` and `y` are relative to the top left corner of the node
+  const Node* set(const Node* node, Coordinate x, Coordinate y, bool value) {
+    if (node->level == 0) {
+      return value ? alive : dead;
+    }
+    Coordinate half = Coordinate{1} << (node->level - 1);
+    bool south = x >= half;
+    bool east = y >= half;
+    const Node* child = set(quadrant(node, south, east), x % half, y % half, value);
+    return join(
+        !south && !east ? child : node->nw,
+        !south && east ? child : node->ne,
+        south && !east ? child : node->sw,
+        south && east ? child : node->se
+    );
+  }
+
+  // Same node one level up, with the original in the centre
+  const Node* expand(const Node* node) {
+    const Node* border = empty(node->level - 1);
+    return join(
+        join(border, border, border, node->nw),
+        join(border, border, node->ne, border),
+        join(border, node->sw, border, border),
+        join(node->se, border, border, border)
+    );
+  }
+
+  // All cells are in the central quarter of the node
+  static bool padded(const Node* node) noexcept {
+    return node->population == node->nw->se->population + node->ne->sw->population + node->sw->ne->population +
+                                   node->se->nw->population;
+  }
+
+  void advance(unsigned step) {
+    while (root->level < step + 2 || !padded(root)) {
+      root = expand(root);
+    }
+    root = successor(expand(root), step);
+  }
+
+  // Centre of a level 2 node after one generation
+  const Node* next_generation(const Node* node) {
+    std::uint32_t cells = 0;
+    for (unsigned x = 0; x < 4; ++x) {
+      for (unsigned y = 0; y < 4; ++y) {
+        const Node* cell = quadrant(quadrant(node, x >= 2, y >= 2), x % 2, y % 2);
+        cells |= static_cast<std::uint32_t>(cell == alive) << (x * 4 + y);
+      }
+    }
+    std::array<const Node*, 4> result;
+    for (unsigned x = 1; x < 3; ++x) {
+      for (unsigned y = 1; y < 3; ++y) {
+        unsigned neighbours = 0;
+        for (unsigned dx = x - 1; dx <= x + 1; ++dx) {
+          for (unsigned dy = y - 1; dy <= y + 1; ++dy) {
+            neighbours += (cells >> (dx * 4 + dy)) & 1;
+          }
+        }
+        bool was_alive = (cells >> (x * 4 + y)) & 1;
+        neighbours -= was_alive;
+        result[(x - 1) * 2 + (y - 1)] = (was_alive ? rule.survives(neighbours) : rule.born(neighbours)) ? alive : dead;
+      }
+    }
+    return join(result[0], result[1], result[2], result[3]);
+  }
+
+  // Centre of the node (one level down) advanced by 2^step generations, step <= level - 2
+  const Node* successor(const Node* node, unsigned step) {
+    if (node->population == 0) {
+      return empty(node->level - 1);
+    }
+    if (node->successors != no_successors && successors[node->successors + step]) {
+      return successors[node->successors + step];
+    }
+    const Node* result;
+    if (node->level == 2) {
+      result = next_generation(node);
+    } else {
+      unsigned inner = std::min(step, node->level - 3);
+      const Node* nw = node->nw;
+      const Node* ne = node->ne;
+      const Node* sw = node->sw;
+      const Node* se = node->se;
+      std::array<const Node*, 9> parts = {
+          successor(nw, inner),
+          successor(join(nw->ne, ne->nw, nw->se, ne->sw), inner),
+          successor(ne, inner),
+          successor(join(nw->sw, nw->se, sw->nw, sw->ne), inner),
+          successor(join(nw->se, ne->sw, sw->ne, se->nw), inner),
+          successor(join(ne->sw, ne->se, se->nw, se->ne), inner),
+          successor(sw, inner),
+          successor(join(sw->ne, se->nw, sw->se, se->sw), inner),
+          successor(se, inner),
+      };
+      auto quarter = [this, &parts, step, node](size_t a, size_t b, size_t c, size_t d) {
+        if (step < node->level - 2) {
+          return join(parts[a]->se, parts[b]->sw, parts[c]->ne, parts[d]->nw);
+        }
+        return successor(join(parts[a], parts[b], parts[c], parts[d]), step - 1);
+      };
+      result = join(quarter(0, 1, 3, 4), quarter(1, 2, 4, 5), quarter(3, 4, 6, 7), quarter(4, 5, 7, 8));
+    }
+    if (node->successors == no_successors) {
+      node->successors = successors.size();
+      successors.resize(successors.size() + node->level - 1);
+    }
+    successors[node->successors + step] = result;
+    return result;
+  }
+
+  // `x` and `y` are the coordinates of the node's top left corner inside the window
+  static void paint(detail::BitGrid& window, const Node* node, Coordinate x, Coordinate y) noexcept {
+    Coordinate size = Coordinate{1} << node->level;
+    if (node->population == 0 || x >= static_cast<Coordinate>(window.sizes[0]) ||
+        y >= static_cast<Coordinate>(window.sizes[1]) || x + size <= 0 || y + size <= 0) {
+      return;
+    }
+    if (node->level == 0) {
+      window.row(x)[y / 64] |= std::uint64_t{1} << (y % 64);
+      return;
+    }
+    Coordinate half = size / 2;
+    paint(window, node->nw, x, y);
+    paint(window, node->ne, x, y + half);
+    paint(window, node->sw, x + half, y);
+    paint(window, node->se, x + half, y + half);
+  }
+
+  LifeRule rule;
+  std::unordered_set<Node, NodeHash, NodeEqual> nodes;
+  std::vector<const Node*> empty_nodes;
+  std::vector<const Node*> successors;
+  const Node* dead;
+  const Node* alive;
+  const Node* root;
+  std::uint64_t current_generation = 0;
+};
+
+} // namespace ct
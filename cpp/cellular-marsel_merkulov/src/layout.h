@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+namespace ct {
+// Memory layouts of the grid storage. `Layout::Map<D>` is built from the extents of the storage and maps
+// coordinates to positions in it; only row-major storage keeps the innermost rows contiguous
+struct RowMajor {
+  template <size_t D>
+  class Map {
+  public:
+    static constexpr bool contiguous_rows = true;
+
+    explicit Map(const std::array<size_t, D>& extents)
+        : extents(extents) {}
+
+    size_t size() const noexcept {
+      size_t result = 1;
+      for (size_t extent : extents) {
+        result *= extent;
+      }
+      return result;
+    }
+
+    size_t encode(const std::array<size_t, D>& coordinates) const noexcept {
+      size_t index = 0;
+      for (size_t dim = 0; dim < D; ++dim) {
+        index = index * extents[dim] + coordinates[dim];
+      }
+      return index;
+    }
+
+    std::array<size_t, D> decode(size_t index) const noexcept {
+      std::array<size_t, D> coordinates;
+      for (size_t dim = D; dim-- > 0;) {
+        coordinates[dim] = index % extents[dim];
+        index /= extents[dim];
+      }
+      return coordinates;
+    }
+
+  private:
+    std::array<size_t, D> extents;
+  };
+};
+
+namespace detail {
+// pdep/pext for a fixed mask. Without BMI2 the bits are moved in six shifts by powers of two, with the bits
+// moving at every shift precomputed (Hacker's Delight, 7-4 and 7-5)
+class BitScatter {
+public:
+  explicit BitScatter(std::uint64_t mask = 0) noexcept
+      : mask(mask) {
+    std::uint64_t remaining = mask;
+    std::uint64_t zeros = ~mask << 1;
+    for (unsigned i = 0; i < moves.size(); ++i) {
+      std::uint64_t parity = zeros;
+      for (unsigned shift = 1; shift < 64; shift <<= 1) {
+        parity ^= parity << shift;
+      }
+      moves[i] = parity & remaining;
+      remaining = (remaining ^ moves[i]) | (moves[i] >> (1u << i));
+      zeros &= ~parity;
+    }
+  }
+
+  std::uint64_t deposit(std::uint64_t value) const noexcept {
+#if defined(__BMI2__)
+    return _pdep_u64(value, mask);
+#else
+    for (unsigned i = moves.size(); i-- > 0;) {
+      value = (value & ~moves[i]) | ((value << (1u << i)) & moves[i]);
+    }
+    return value & mask;
+#endif
+  }
+
+  std::uint64_t extract(std::uint64_t value) const noexcept {
+#if defined(__BMI2__)
+    return _pext_u64(value, mask);
+#else
+    value &= mask;
+    for (unsigned i = 0; i < moves.size(); ++i) {
+      std::uint64_t moving = value & moves[i];
+      value = (value ^ moving) | (moving >> (1u << i));
+    }
+    return value;
+#endif
+  }
+
+private:
+  std::uint64_t mask;
+  std::array<std::uint64_t, 6> moves{};
+};
+} // namespace detail
+
+// Z-order: the bits of the coordinates are interleaved, so cells close along any dimension are mostly close
+// in memory. Every extent is rounded up to a power of two; once the bits of a short dimension run out, the
+// remaining dimensions are interleaved alone
+struct Morton {
+  template <size_t D>
+  class Map {
+  public:
+    static constexpr bool contiguous_rows = false;
+
+    explicit Map(const std::array<size_t, D>& extents) {
+      std::array<unsigned, D> bits;
+      unsigned total = 0;
+      unsigned levels = 0;
+      for (size_t dim = 0; dim < D; ++dim) {
+        bits[dim] = std::bit_width(extents[dim] > 1 ? extents[dim] - 1 : 0);
+        total += bits[dim];
+        levels = std::max(levels, bits[dim]);
+      }
+      if (total >= 64) {
+        throw std::length_error("grid is too large for the Morton layout");
+      }
+      std::array<std::uint64_t, D> masks{};
+      unsigned position = 0;
+      for (unsigned level = 0; level < levels; ++level) {
+        for (size_t dim = D; dim-- > 0;) {
+          if (level < bits[dim]) {
+            masks[dim] |= std::uint64_t{1} << position++;
+          }
+        }
+      }
+      for (size_t dim = 0; dim < D; ++dim) {
+        scatters[dim] = detail::BitScatter(masks[dim]);
+      }
+      storage = std::uint64_t{1} << total;
+    }
+
+    size_t size() const noexcept {
+      return storage;
+    }
+
+    size_t encode(const std::array<size_t, D>& coordinates) const noexcept {
+      std::uint64_t index = 0;
+      for (size_t dim = 0; dim < D; ++dim) {
+        index |= scatters[dim].deposit(coordinates[dim]);
+      }
+      return index;
+    }
+
+    std::array<size_t, D> decode(size_t index) const noexcept {
+      std::array<size_t, D> coordinates;
+      for (size_t dim = 0; dim < D; ++dim) {
+        coordinates[dim] = scatters[dim].extract(index);
+      }
+      return coordinates;
+    }
+
+  private:
+    std::array<detail::BitScatter, D> scatters;
+    size_t storage;
+  };
+};
+
+// Cubic bricks of `Edge` cells along every dimension stored one after another, row-major both inside a brick
+// and between bricks; every extent is rounded up to a multiple of `Edge`
+template <size_t Edge = 4>
+struct Brick {
+  static_assert(std::has_single_bit(Edge), "brick edge must be a power of two");
+
+  template <size_t D>
+  class Map {
+    static constexpr unsigned shift = std::countr_zero(Edge);
+
+  public:
+    static constexpr bool contiguous_rows = false;
+
+    explicit Map(const std::array<size_t, D>& extents) {
+      for (size_t dim = 0; dim < D; ++dim) {
+        bricks[dim] = (extents[dim] + Edge - 1) >> shift;
+      }
+    }
+
+    size_t size() const noexcept {
+      size_t result = 1;
+      for (size_t count : bricks) {
+        result *= count << shift;
+      }
+      return result;
+    }
+
+    size_t encode(const std::array<size_t, D>& coordinates) const noexcept {
+      size_t brick = 0;
+      size_t inner = 0;
+      for (size_t dim = 0; dim < D; ++dim) {
+        brick = brick * bricks[dim] + (coordinates[dim] >> shift);
+        inner = (inner << shift) | (coordinates[dim] & (Edge - 1));
+      }
+      return (brick << (shift * D)) | inner;
+    }
+
+    std::array<size_t, D> decode(size_t index) const noexcept {
+      std::array<size_t, D> coordinates;
+      size_t brick = index >> (shift * D);
+      for (size_t dim = D; dim-- > 0;) {
+        coordinates[dim] = ((brick % bricks[dim]) << shift) | (index & (Edge - 1));
+        brick /= bricks[dim];
+        index >>= shift;
+      }
+      return coordinates;
+    }
+
+  private:
+    std::array<size_t, D> bricks;
+  };
+};
+} // namespace ct
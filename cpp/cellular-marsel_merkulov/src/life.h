@@ -0,0 +1,397 @@
+#pragma once
+
+#include "boundary.h"
+#include "cellular.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace ct {
+
+// Outer-totalistic rule on the radius 1 Moore neighbourhood, written in B/S notation ("B3/S23" is Conway's Life)
+class LifeRule {
+public:
+  constexpr LifeRule(std::uint16_t birth, std::uint16_t survival, Boundary boundary = Boundary::fixed) noexcept
+      : birth(birth)
+      , survival(survival)
+      , edges(boundary) {}
+
+  static constexpr LifeRule conway(Boundary boundary = Boundary::fixed) noexcept {
+    return LifeRule(1 << 3, 1 << 2 | 1 << 3, boundary);
+  }
+
+  static LifeRule parse(std::string_view notation, Boundary boundary = Boundary::fixed) {
+    std::uint16_t birth = 0;
+    std::uint16_t survival = 0;
+    std::uint16_t* counts = nullptr;
+    for (char c : notation) {
+      if (c == 'B' || c == 'b') {
+        counts = &birth;
+      } else if (c == 'S' || c == 's') {
+        counts = &survival;
+      } else if (c == '/') {
+        counts = nullptr;
+      } else if (c >= '0' && c <= '8' && counts) {
+        *counts |= 1 << (c - '0');
+      } else {
+        throw std::invalid_argument("invalid B/S rule notation");
+      }
+    }
+    return LifeRule(birth, survival, boundary);
+  }
+
+  constexpr bool born(size_t neighbours) const noexcept {
+    return (birth >> neighbours) & 1;
+  }
+
+  constexpr bool survives(size_t neighbours) const noexcept {
+    return (survival >> neighbours) & 1;
+  }
+
+  constexpr Boundary boundary() const noexcept {
+    return edges;
+  }
+
+  // Reference evaluation through any grid view, the bit-packed engine below does not call it
+  template <typename Grid>
+  bool operator()(const Grid& grid, size_t x, size_t y) const {
+    size_t rows = grid.extent(0);
+    size_t columns = grid.extent(1);
+    size_t neighbours = 0;
+    for (std::ptrdiff_t dx = -1; dx <= 1; ++dx) {
+      for (std::ptrdiff_t dy = -1; dy <= 1; ++dy) {
+        if (dx == 0 && dy == 0) {
+          continue;
+        }
+        std::ptrdiff_t nx = static_cast<std::ptrdiff_t>(x) + dx;
+        std::ptrdiff_t ny = static_cast<std::ptrdiff_t>(y) + dy;
+        if (nx < 0 || ny < 0 || static_cast<size_t>(nx) >= rows || static_cast<size_t>(ny) >= columns) {
+          if (edges == Boundary::fixed) {
+            continue;
+          }
+          nx = static_cast<std::ptrdiff_t>(detail::boundary_coordinate(edges, nx, rows));
+          ny = static_cast<std::ptrdiff_t>(detail::boundary_coordinate(edges, ny, columns));
+        }
+        neighbours += grid[static_cast<size_t>(nx), static_cast<size_t>(ny)];
+      }
+    }
+    return grid[x, y] ? survives(neighbours) : born(neighbours);
+  }
+
+private:
+  std::uint16_t birth;
+  std::uint16_t survival;
+  Boundary edges;
+};
+
+namespace detail {
+class BitReference {
+public:
+  BitReference(std::uint64_t& word, std::uint64_t mask) noexcept
+      : word(word)
+      , mask(mask) {}
+
+  operator bool() const noexcept {
+    return (word & mask) != 0;
+  }
+
+  const BitReference& operator=(bool value) const noexcept {
+    word = value ? word | mask : word & ~mask;
+    return *this;
+  }
+
+  const BitReference& operator=(const BitReference& other) const noexcept {
+    return *this = static_cast<bool>(other);
+  }
+
+private:
+  std::uint64_t& word;
+  std::uint64_t mask;
+};
+
+// 64 cells per word; every row is framed by a guard word on each side so that shifted loads never leave it
+struct BitGrid {
+  explicit BitGrid(const std::array<size_t, 2>& extents)
+      : sizes(extents)
+      , words((extents[1] + 63) / 64)
+      , stride(words + 2)
+      , data(extents[0] * stride) {}
+
+  std::uint64_t* row(size_t x) noexcept {
+    return data.data() + x * stride + 1;
+  }
+
+  const std::uint64_t* row(size_t x) const noexcept {
+    return data.data() + x * stride + 1;
+  }
+
+  std::array<size_t, 2> sizes;
+  size_t words;
+  size_t stride;
+  std::vector<std::uint64_t> data;
+};
+} // namespace detail
+
+template <typename State>
+  requires std::is_same_v<std::remove_const_t<State>, bool>
+class BitGridView {
+  using Data = detail::BitGrid;
+  using Reference = std::conditional_t<std::is_const_v<State>, bool, detail::BitReference>;
+
+  template <typename U>
+    requires std::is_same_v<std::remove_const_t<U>, bool>
+  friend class BitGridView;
+
+public:
+  explicit BitGridView(Data& data)
+      : data(data) {}
+
+  template <typename U>
+    requires (std::is_same_v<U, bool> && std::is_const_v<State>)
+  BitGridView(const BitGridView<U>& other)
+      : data(other.data) {}
+
+  size_t extent(size_t dim) const {
+    return data.sizes[dim];
+  }
+
+  template <typename... Indices>
+    requires (sizeof...(Indices) == 2 && (std::convertible_to<Indices, size_t> && ...))
+  Reference operator[](Indices... indices) const {
+    return operator[](std::array<size_t, 2>{static_cast<size_t>(indices)...});
+  }
+
+  Reference operator[](const std::array<size_t, 2>& indices) const {
+    std::uint64_t& word = data.row(indices[0])[indices[1] / 64];
+    std::uint64_t mask = std::uint64_t{1} << (indices[1] % 64);
+    if constexpr (std::is_const_v<State>) {
+      return (word & mask) != 0;
+    } else {
+      return detail::BitReference(word, mask);
+    }
+  }
+
+private:
+  Data& data;
+};
+
+// Bit-packed engine: a generation is computed 64 cells (256 with AVX2) at a time by bit-sliced adders
+template <>
+class CellularAutomaton<bool, LifeRule, 2> {
+  using Data = detail::BitGrid;
+  using IndexArray = std::array<size_t, 2>;
+  using Word = std::uint64_t;
+#if defined(__AVX2__)
+  using Vector = std::uint64_t __attribute__((vector_size(32)));
+#endif
+
+public:
+  CellularAutomaton(const IndexArray& extents, size_t n_threads, LifeRule rule = LifeRule::conway())
+      : data(extents)
+      , step_new_data(extents)
+      , zero_row(data.stride)
+      , rule(rule)
+      , pool(n_threads) {}
+
+  CellularAutomaton(const CellularAutomaton&) = delete;
+  CellularAutomaton& operator=(const CellularAutomaton&) = delete;
+
+  BitGridView<const bool> grid() noexcept {
+    finish_step();
+    return BitGridView<const bool>(data);
+  }
+
+  BitGridView<const bool> grid() const noexcept {
+    return BitGridView<const bool>(const_cast<Data&>(data));
+  }
+
+  BitGridView<bool> edit() noexcept {
+    finish_step();
+    return BitGridView<bool>(data);
+  }
+
+  void set(const IndexArray& indices, bool state) {
+    edit()[indices] = state;
+  }
+
+  void step() {
+    step_async().wait();
+  }
+
+  StepHandle<CellularAutomaton> step_async() {
+    finish_step();
+    if (data.words == 0) {
+      return StepHandle<CellularAutomaton>(*this, pool.skip());
+    }
+    if (rule.boundary() != Boundary::fixed) {
+      wrap_columns();
+    }
+    return StepHandle<CellularAutomaton>(*this, pool.start(step_job));
+  }
+
+  // timings of the last completed generation; `step(generations)` runs them one by one
+  const StepStats& stats() const noexcept {
+    return pool.stats();
+  }
+
+  void step(size_t generations) {
+    for (; generations > 0; --generations) {
+      step();
+    }
+  }
+
+private:
+  friend class StepHandle<CellularAutomaton>;
+
+  struct StepJob {
+    CellularAutomaton* automaton;
+
+    void operator()(size_t worker_id) const noexcept {
+      automaton->compute(worker_id);
+    }
+  };
+
+  void finish_step() noexcept {
+    if (pool.finish()) {
+      data.data.swap(step_new_data.data);
+    }
+  }
+
+  // Puts copies of the edge cells seen through the boundary right outside of every row: the cell before the
+  // first one goes to the top bit of the left guard word, the cell after the last one to the bit right after it
+  void wrap_columns() noexcept {
+    size_t columns = data.sizes[1];
+    bool toroidal = rule.boundary() == Boundary::toroidal;
+    size_t before = toroidal ? columns - 1 : 0;
+    size_t beyond = toroidal ? 0 : columns - 1;
+    Word after = Word{1} << (columns % 64);
+    for (size_t x = 0; x < data.sizes[0]; ++x) {
+      Word* row = data.row(x);
+      row[-1] = ((row[before / 64] >> (before % 64)) & 1) << 63;
+      bool last = (row[beyond / 64] >> (beyond % 64)) & 1;
+      row[columns / 64] = last ? row[columns / 64] | after : row[columns / 64] & ~after;
+    }
+  }
+
+  void compute(size_t worker_id) noexcept {
+    size_t rows = data.sizes[0];
+    size_t last = rows * (worker_id + 1) / pool.size();
+    for (size_t x = rows * worker_id / pool.size(); x < last; ++x) {
+      compute_row(x);
+    }
+  }
+
+  const Word* source_row(size_t x, size_t offset) const noexcept {
+    size_t rows = data.sizes[0];
+    size_t nx = x + offset - 1;
+    if (nx < rows) {
+      return data.row(nx);
+    }
+    if (rule.boundary() == Boundary::toroidal) {
+      return data.row((x + offset + rows - 1) % rows);
+    }
+    // the only rows outside are the ones next to the edge rows, which reflect into themselves
+    return rule.boundary() == Boundary::reflect ? data.row(x) : zero_row.data() + 1;
+  }
+
+  void compute_row(size_t x) noexcept {
+    const Word* above = source_row(x, 0);
+    const Word* row = source_row(x, 1);
+    const Word* below = source_row(x, 2);
+    Word* target = step_new_data.row(x);
+    size_t k = 0;
+#if defined(__AVX2__)
+    for (; k + 4 <= data.words; k += 4) {
+      Vector next = next_words<Vector>(above + k, row + k, below + k);
+      std::memcpy(target + k, &next, sizeof(next));
+    }
+#endif
+    for (; k < data.words; ++k) {
+      target[k] = next_words<Word>(above + k, row + k, below + k);
+    }
+    if (size_t tail = data.sizes[1] % 64) {
+      target[data.words - 1] &= (Word{1} << tail) - 1;
+    }
+  }
+
+  template <typename Block>
+  static Block load(const Word* source) noexcept {
+    Block block;
+    std::memcpy(&block, source, sizeof(block));
+    return block;
+  }
+
+  template <typename Block>
+  static void load_shifted(const Word* source, Block& west, Block& centre, Block& east) noexcept {
+    centre = load<Block>(source);
+    west = (centre << 1) | (load<Block>(source - 1) >> 63);
+    east = (centre >> 1) | (load<Block>(source + 1) << 63);
+  }
+
+  template <typename Block>
+  static void full_add(Block a, Block b, Block c, Block& sum, Block& carry) noexcept {
+    Block half = a ^ b;
+    sum = half ^ c;
+    carry = (a & b) | (half & c);
+  }
+
+  template <typename Block>
+  static Block select(size_t bit, Block plane) noexcept {
+    return bit ? plane : ~plane;
+  }
+
+  // Counts the eight neighbours of every bit into four bit planes and applies the rule to the counts
+  template <typename Block>
+  Block next_words(const Word* above, const Word* row, const Word* below) const noexcept {
+    Block above_west, above_centre, above_east;
+    Block west, alive, east;
+    Block below_west, below_centre, below_east;
+    load_shifted(above, above_west, above_centre, above_east);
+    load_shifted(row, west, alive, east);
+    load_shifted(below, below_west, below_centre, below_east);
+
+    Block ones_above, twos_above, ones_side, twos_side;
+    full_add(above_west, above_centre, above_east, ones_above, twos_above);
+    full_add(west, east, below_west, ones_side, twos_side);
+    Block ones_below = below_centre ^ below_east;
+    Block twos_below = below_centre & below_east;
+
+    Block ones, twos_carry, twos_sum, fours_carry;
+    full_add(ones_above, ones_side, ones_below, ones, twos_carry);
+    full_add(twos_above, twos_side, twos_below, twos_sum, fours_carry);
+    Block twos = twos_sum ^ twos_carry;
+    Block fours_sum = twos_sum & twos_carry;
+    Block fours = fours_sum ^ fours_carry;
+    Block eights = fours_sum & fours_carry;
+
+    Block result{};
+    for (size_t n = 0; n <= 8; ++n) {
+      bool born = rule.born(n);
+      bool survives = rule.survives(n);
+      if (!born && !survives) {
+        continue;
+      }
+      Block match = select(n & 1, ones) & select(n & 2, twos) & select(n & 4, fours) & select(n & 8, eights);
+      if (!born) {
+        match &= alive;
+      } else if (!survives) {
+        match &= ~alive;
+      }
+      result |= match;
+    }
+    return result;
+  }
+
+  Data data;
+  Data step_new_data;
+  std::vector<Word> zero_row;
+  LifeRule rule;
+  StepJob step_job{this};
+  detail::StepPool pool;
+};
+
+} // namespace ct
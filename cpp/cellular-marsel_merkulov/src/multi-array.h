@@ -1,28 +1,68 @@
 #pragma once
 
+#include "boundary.h"
+#include "layout.h"
+
 #include <array>
+#include <utility>
 #include <vector>
 
 namespace ct::detail {
-template <typename State, size_t D>
+// With a nonzero `padding` every dimension is framed by that many ghost cells on each side. `sizes` stays the
+// logical size, and indices in [-padding, size + padding) (negative ones wrapped around as size_t) reach the ghosts
+template <typename State, size_t D, typename Layout = RowMajor>
 struct MultiArr {
-  explicit MultiArr(const std::array<std::size_t, D>& extends)
-      : sizes(extends) {
-    size_t size = 1;
-    for (size_t i = 0; i < D; ++i) {
-      size *= extends[i];
+  using Map = typename Layout::template Map<D>;
+
+  static constexpr bool contiguous_rows = Map::contiguous_rows;
+
+  explicit MultiArr(const std::array<std::size_t, D>& extends, size_t padding = 0)
+      : sizes(extends)
+      , padding(padding)
+      , rows(extends[0] + 2 * padding)
+      , map(padded(extends, padding)) {
+    data.resize(map.size());
+  }
+
+  // Stores only the `rows` rows starting at `origin` (wrapping around the end of the grid) of a grid of size
+  // `extends`, without padding. Cells are still addressed by their coordinates in the whole grid
+  MultiArr(const std::array<std::size_t, D>& extends, size_t origin, size_t rows)
+      : sizes(extends)
+      , padding(0)
+      , origin(origin)
+      , rows(rows)
+      , map(window(extends, rows)) {
+    data.resize(map.size());
+  }
+
+  // number of logical cells
+  size_t cells() const noexcept {
+    size_t count = 1;
+    for (size_t size : sizes) {
+      count *= size;
     }
-    data.resize(size);
+    return count;
+  }
+
+  // distance between cells adjacent along `dim`, only for layouts with contiguous rows
+  size_t stride(size_t dim) const noexcept {
+    size_t result = 1;
+    for (size_t i = dim + 1; i < D; ++i) {
+      result *= sizes[i] + 2 * padding;
+    }
+    return result;
   }
 
   size_t to_primary(std::array<size_t, D> indices) const {
-    size_t index = 0;
-    size_t cur_index = 1;
-    for (size_t i = D; i-- > 0;) {
-      index += indices[i] * cur_index;
-      cur_index *= sizes[i];
+    for (size_t& index : indices) {
+      index += padding;
+    }
+    // rows before `origin` follow the last grid row in a window
+    indices[0] -= origin;
+    if (indices[0] >= rows) {
+      indices[0] += sizes[0];
     }
-    return index;
+    return map.encode(indices);
   }
 
   template <typename... Indices>
@@ -32,14 +72,113 @@ struct MultiArr {
   }
 
   std::array<std::size_t, D> from_primary(std::size_t index) const {
-    std::array<size_t, D> indices;
-    for (size_t i = D; i-- > 0;) {
-      indices[i] = index % sizes[i];
-      index /= sizes[i];
+    std::array<size_t, D> indices = map.decode(index);
+    for (size_t& coordinate : indices) {
+      coordinate -= padding;
+    }
+    if (origin != 0) {
+      indices[0] = (indices[0] + origin) % sizes[0];
     }
     return indices;
   }
 
+  // Copies the boundary into the ghost cells; every ghost is mapped to a logical cell dimension by dimension,
+  // so the result does not depend on the order the ghosts are filled in
+  void fill_ghosts(Boundary boundary, const State& value) {
+    if (padding == 0 || cells() == 0) {
+      return;
+    }
+    auto logical = [this](size_t dim, size_t coordinate) {
+      return coordinate >= padding && coordinate - padding < sizes[dim];
+    };
+    auto fill = [this, boundary, &value](const std::array<size_t, D>& position) {
+      size_t index = map.encode(position);
+      std::array<size_t, D> source;
+      for (size_t dim = 0; dim < D; ++dim) {
+        auto coordinate = static_cast<std::ptrdiff_t>(position[dim]) - static_cast<std::ptrdiff_t>(padding);
+        if (boundary == Boundary::fixed && (coordinate < 0 || static_cast<size_t>(coordinate) >= sizes[dim])) {
+          data[index] = value;
+          return;
+        }
+        source[dim] = boundary_coordinate(boundary, coordinate, sizes[dim]);
+      }
+      data[index] = data[to_primary(source)];
+    };
+    size_t length = sizes[D - 1] + 2 * padding;
+    std::array<size_t, D> position{};
+    for (bool more = true; more;) {
+      bool inner_row = true;
+      for (size_t dim = 0; dim + 1 < D; ++dim) {
+        inner_row &= logical(dim, position[dim]);
+      }
+      for (position[D - 1] = 0; position[D - 1] < length; ++position[D - 1]) {
+        if (!inner_row || !logical(D - 1, position[D - 1])) {
+          fill(position);
+        } else {
+          position[D - 1] = padding + sizes[D - 1] - 1;
+        }
+      }
+      more = false;
+      for (size_t dim = D - 1; dim-- > 0;) {
+        if (++position[dim] < sizes[dim] + 2 * padding) {
+          more = true;
+          break;
+        }
+        position[dim] = 0;
+      }
+    }
+  }
+
+  // Visits the runs of cells that are contiguous in memory (whole innermost rows, or the range itself for D == 1;
+  // single cells for other layouts) whose outermost index lies in [first, last), calling
+  // `function(first_indices, first_index, length)`
+  template <typename Function>
+  void for_each_row(size_t first, size_t last, Function&& function) const {
+    if (first >= last || cells() == 0) {
+      return;
+    }
+    std::array<size_t, D> indices{};
+    indices[0] = first;
+    if constexpr (D == 1) {
+      if constexpr (contiguous_rows) {
+        function(std::as_const(indices), to_primary(indices), last - first);
+      } else {
+        for (; indices[0] < last; ++indices[0]) {
+          function(std::as_const(indices), to_primary(indices), size_t{1});
+        }
+      }
+    } else {
+      size_t length = sizes[D - 1];
+      while (indices[0] < last) {
+        if constexpr (contiguous_rows) {
+          function(std::as_const(indices), to_primary(indices), length);
+        } else {
+          for (; indices[D - 1] < length; ++indices[D - 1]) {
+            function(std::as_const(indices), to_primary(indices), size_t{1});
+          }
+          indices[D - 1] = 0;
+        }
+        for (size_t dim = D - 1; dim-- > 0;) {
+          if (++indices[dim] < sizes[dim] || dim == 0) {
+            break;
+          }
+          indices[dim] = 0;
+        }
+      }
+    }
+  }
+
+  // Visits the cells whose outermost index lies in [first, last) in memory order, keeping the indices
+  // up to date incrementally instead of recovering them from the primary index
+  template <typename Function>
+  void for_each_index(size_t first, size_t last, Function&& function) const {
+    for_each_row(first, last, [&function](std::array<size_t, D> indices, size_t index, size_t length) {
+      for (size_t end = indices[D - 1] + length; indices[D - 1] < end; ++indices[D - 1], ++index) {
+        function(std::as_const(indices), index);
+      }
+    });
+  }
+
   template <typename... Indices>
     requires (sizeof...(Indices) == D)
   State& operator[](Indices... indices) {
@@ -52,6 +191,24 @@ struct MultiArr {
 
   std::vector<State> data;
   std::array<size_t, D> sizes;
+  size_t padding;
+  // first grid row and number of rows in the storage
+  size_t origin = 0;
+  size_t rows;
+  Map map;
+
+private:
+  static std::array<size_t, D> padded(std::array<size_t, D> extents, size_t padding) noexcept {
+    for (size_t& extent : extents) {
+      extent += 2 * padding;
+    }
+    return extents;
+  }
+
+  static std::array<size_t, D> window(std::array<size_t, D> extents, size_t rows) noexcept {
+    extents[0] = rows;
+    return extents;
+  }
 };
 
 } // namespace ct::detail
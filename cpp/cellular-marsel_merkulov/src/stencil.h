@@ -0,0 +1,187 @@
+#pragma once
+
+#include "boundary.h"
+#include "multi-array.h"
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <utility>
+
+namespace ct {
+// Neighbourhoods for stencil rules: all cells within Chebyshev (Moore) or Manhattan (von Neumann)
+// distance `Radius` of the cell, the cell itself excluded
+template <size_t Radius>
+struct Moore {
+  static constexpr size_t radius = Radius;
+
+  template <size_t D>
+  static constexpr bool contains(const std::array<std::ptrdiff_t, D>&) noexcept {
+    return true;
+  }
+};
+
+template <size_t Radius>
+struct VonNeumann {
+  static constexpr size_t radius = Radius;
+
+  template <size_t D>
+  static constexpr bool contains(const std::array<std::ptrdiff_t, D>& offset) noexcept {
+    std::ptrdiff_t distance = 0;
+    for (std::ptrdiff_t coordinate : offset) {
+      distance += coordinate < 0 ? -coordinate : coordinate;
+    }
+    return distance <= static_cast<std::ptrdiff_t>(Radius);
+  }
+};
+
+namespace detail {
+template <typename Neighbourhood, size_t D, typename Function>
+constexpr void for_each_offset(Function&& function) {
+  constexpr auto radius = static_cast<std::ptrdiff_t>(Neighbourhood::radius);
+  std::array<std::ptrdiff_t, D> offset;
+  offset.fill(-radius);
+  while (true) {
+    if (offset != std::array<std::ptrdiff_t, D>{} && Neighbourhood::template contains<D>(offset)) {
+      function(std::as_const(offset));
+    }
+    size_t dim = D;
+    while (dim-- > 0 && ++offset[dim] > radius) {
+      offset[dim] = -radius;
+    }
+    if (dim == static_cast<size_t>(-1)) {
+      return;
+    }
+  }
+}
+} // namespace detail
+
+template <typename Neighbourhood, size_t D>
+inline constexpr size_t neighbourhood_size = [] {
+  size_t size = 0;
+  detail::for_each_offset<Neighbourhood, D>([&size](const auto&) {
+    ++size;
+  });
+  return size;
+}();
+
+// Offsets of the neighbours in the order they are passed to a stencil rule (row-major order of the offsets)
+template <typename Neighbourhood, size_t D>
+inline constexpr auto neighbour_offsets = [] {
+  std::array<std::array<std::ptrdiff_t, D>, neighbourhood_size<Neighbourhood, D>> offsets{};
+  size_t i = 0;
+  detail::for_each_offset<Neighbourhood, D>([&offsets, &i](const auto& offset) {
+    offsets[i++] = offset;
+  });
+  return offsets;
+}();
+
+template <typename State, typename Neighbourhood, size_t D>
+using Neighbours = std::array<State, neighbourhood_size<Neighbourhood, D>>;
+
+namespace detail {
+// A stencil rule declares `using neighbourhood = ...` and computes the new state from the cell's state and the
+// states of its neighbours; neighbours outside of the grid are taken according to an optional
+// `static constexpr Boundary boundary` (toroidal by default, default-constructed states for `Boundary::fixed`)
+template <typename State, size_t D, typename Rule>
+concept StencilRules = requires { typename Rule::neighbourhood; } &&
+                       requires (Rule rule, const State& cell, const Neighbours<State, typename Rule::neighbourhood, D>& neighbours) {
+                         { std::invoke(rule, cell, neighbours) } -> std::convertible_to<State>;
+                       };
+
+// Gathers the neighbours of interior cells through precomputed flat offsets; only cells closer than the radius
+// to the border of the grid go through the per-dimension boundary handling, unless the ghost cells of the
+// storage already cover the neighbourhood. Layouts without contiguous rows always take the per-dimension path
+template <typename State, size_t D, typename Rule, typename Layout = RowMajor>
+class StencilEvaluator {
+  using Neighbourhood = typename Rule::neighbourhood;
+  using Data = MultiArr<State, D, Layout>;
+  using IndexArray = std::array<size_t, D>;
+
+  static constexpr auto& offsets = neighbour_offsets<Neighbourhood, D>;
+  static constexpr size_t radius = Neighbourhood::radius;
+  static constexpr Boundary boundary = rule_boundary<Rule>();
+
+public:
+  explicit StencilEvaluator(const Data& data)
+      : sizes(data.sizes)
+      , padded(Data::contiguous_rows && data.padding >= radius) {
+    for (size_t k = 0; k < offsets.size() && Data::contiguous_rows; ++k) {
+      for (size_t dim = 0; dim < D; ++dim) {
+        flat_offsets[k] += offsets[k][dim] * static_cast<std::ptrdiff_t>(data.stride(dim));
+      }
+    }
+  }
+
+  // Calls `visit(index, state)` with the new state of every cell whose outermost index lies in [first, last)
+  template <typename Visit>
+  void evaluate(Rule& rule, const Data& source, size_t first, size_t last, Visit&& visit) const {
+    source.for_each_row(first, last, [&](const IndexArray& start, size_t index, size_t length) {
+      size_t begin = start[D - 1];
+      size_t end = begin + length;
+      size_t fast_begin = end;
+      size_t fast_end = end;
+      if (padded) {
+        fast_begin = begin;
+        fast_end = end;
+      } else if (Data::contiguous_rows && interior(start)) {
+        fast_begin = std::clamp(radius, begin, end);
+        fast_end = std::clamp(sizes[D - 1] > radius ? sizes[D - 1] - radius : 0, fast_begin, end);
+      }
+      IndexArray indices = start;
+      for (indices[D - 1] = begin; indices[D - 1] < fast_begin; ++indices[D - 1]) {
+        size_t cell = index + indices[D - 1] - begin;
+        visit(cell, evaluate_border(rule, source, indices, cell));
+      }
+      for (size_t cell = index + fast_begin - begin; cell < index + fast_end - begin; ++cell) {
+        visit(cell, evaluate_interior(rule, source, cell));
+      }
+      for (indices[D - 1] = fast_end; indices[D - 1] < end; ++indices[D - 1]) {
+        size_t cell = index + indices[D - 1] - begin;
+        visit(cell, evaluate_border(rule, source, indices, cell));
+      }
+    });
+  }
+
+private:
+  // whether all dimensions but the innermost one keep the whole neighbourhood inside the grid
+  bool interior(const IndexArray& indices) const noexcept {
+    for (size_t dim = 0; dim + 1 < D; ++dim) {
+      if (indices[dim] < radius || indices[dim] + radius >= sizes[dim]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  State evaluate_interior(Rule& rule, const Data& source, size_t cell) const {
+    Neighbours<State, Neighbourhood, D> neighbours;
+    for (size_t k = 0; k < offsets.size(); ++k) {
+      neighbours[k] = source.data[cell + flat_offsets[k]];
+    }
+    return std::invoke(rule, source.data[cell], std::as_const(neighbours));
+  }
+
+  State evaluate_border(Rule& rule, const Data& source, const IndexArray& indices, size_t cell) const {
+    Neighbours<State, Neighbourhood, D> neighbours;
+    for (size_t k = 0; k < offsets.size(); ++k) {
+      IndexArray neighbour;
+      bool outside = false;
+      for (size_t dim = 0; dim < D; ++dim) {
+        std::ptrdiff_t coordinate = static_cast<std::ptrdiff_t>(indices[dim]) + offsets[k][dim];
+        outside |= coordinate < 0 || coordinate >= static_cast<std::ptrdiff_t>(sizes[dim]);
+        neighbour[dim] = boundary_coordinate(boundary, coordinate, sizes[dim]);
+      }
+      neighbours[k] = outside && boundary == Boundary::fixed ? State{} : source.data[source.to_primary(neighbour)];
+    }
+    return std::invoke(rule, source.data[cell], std::as_const(neighbours));
+  }
+
+  IndexArray sizes;
+  bool padded;
+  std::array<std::ptrdiff_t, offsets.size()> flat_offsets{};
+};
+} // namespace detail
+} // namespace ct
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "boundary.h"
+#include "stencil.h"
+
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ct {
+// Stencil rule whose new state depends only on the state of the cell and on how many of its neighbours are in
+// each state. The transition `function(state, counts)` is tabulated at construction; a step then costs one sum
+// of per-state weights over the neighbours and one lookup per cell. States are 0 .. States - 1
+template <size_t States, typename Neighbourhood = Moore<1>, size_t D = 2, Boundary Edges = Boundary::toroidal>
+class Totalistic {
+  static_assert(States >= 2 && States <= 256);
+
+  static constexpr size_t neighbours = neighbourhood_size<Neighbourhood, D>;
+
+  // counts of all states but the last one are digits in base `neighbours + 1`, the last count is implied
+  static constexpr auto weights = [] {
+    std::array<size_t, States> result{};
+    size_t weight = 1;
+    for (size_t state = 0; state + 1 < States; ++state) {
+      result[state] = weight;
+      weight *= neighbours + 1;
+    }
+    return result;
+  }();
+
+  static constexpr size_t keys = weights[States - 2] * (neighbours + 1);
+
+  static_assert(keys * States <= (size_t{1} << 24), "the transition table is too large");
+
+public:
+  using neighbourhood = Neighbourhood;
+  using Counts = std::array<size_t, States>;
+
+  static constexpr Boundary boundary = Edges;
+
+  template <typename Function>
+    requires std::convertible_to<std::invoke_result_t<Function&, size_t, const Counts&>, size_t>
+  explicit Totalistic(Function function)
+      : table(keys * States) {
+    for (size_t key = 0; key < keys; ++key) {
+      Counts counts{};
+      size_t rest = key;
+      size_t total = 0;
+      for (size_t state = 0; state + 1 < States; ++state) {
+        counts[state] = rest % (neighbours + 1);
+        rest /= neighbours + 1;
+        total += counts[state];
+      }
+      if (total > neighbours) {
+        continue;
+      }
+      counts[States - 1] = neighbours - total;
+      for (size_t state = 0; state < States; ++state) {
+        size_t next = std::invoke(function, state, std::as_const(counts));
+        if (next >= States) {
+          throw std::out_of_range("transition to a state outside of the rule's states");
+        }
+        table[state * keys + key] = static_cast<std::uint8_t>(next);
+      }
+    }
+  }
+
+  template <typename State>
+  State operator()(const State& cell, const Neighbours<State, Neighbourhood, D>& states) const {
+    size_t key = static_cast<size_t>(cell) * keys;
+    for (const State& state : states) {
+      key += weights[static_cast<size_t>(state)];
+    }
+    return static_cast<State>(table[key]);
+  }
+
+private:
+  std::vector<std::uint8_t> table;
+};
+} // namespace ct
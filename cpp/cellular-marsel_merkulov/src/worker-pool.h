@@ -0,0 +1,313 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace ct {
+// Timings of the last parallel job of a step. `wait[i]` is the part of the job's wall time the i-th worker did
+// not spend computing (waking up and waiting for the slowest worker); `imbalance` is the slowest worker's
+// compute time over the mean one
+struct StepStats {
+  using Duration = std::chrono::steady_clock::duration;
+
+  Duration wall{};
+  std::vector<Duration> compute;
+  std::vector<Duration> wait;
+  double imbalance = 1;
+};
+} // namespace ct
+
+namespace ct::detail {
+inline constexpr size_t cache_line_size = 64;
+inline constexpr size_t spin_count = 1 << 8;
+
+inline void cpu_relax() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+// spinning only pays off when the thread we wait for can run at the same time
+inline size_t spin_limit() noexcept {
+  static const size_t limit = std::thread::hardware_concurrency() > 1 ? spin_count : 0;
+  return limit;
+}
+
+// Spins for a short while, then parks on the atomic until `ready` accepts its value
+template <typename T, typename Predicate>
+void spin_wait(const std::atomic<T>& value, Predicate ready) noexcept {
+  for (size_t i = 0, limit = spin_limit(); i < limit; ++i) {
+    if (ready(value.load(std::memory_order_acquire))) {
+      return;
+    }
+    cpu_relax();
+  }
+  while (true) {
+    T current = value.load(std::memory_order_acquire);
+    if (ready(current)) {
+      return;
+    }
+    value.wait(current, std::memory_order_acquire);
+  }
+}
+
+// Persistent threads synchronized by a generation counter: `start` publishes a job by bumping
+// the generation, every worker reports completion through its own cache line
+class WorkerPool {
+public:
+  explicit WorkerPool(size_t n_threads)
+      : workers(std::make_unique<Worker[]>(n_threads))
+      , n_threads(n_threads) {
+    threads.reserve(n_threads);
+    for (size_t worker_id = 0; worker_id < n_threads; ++worker_id) {
+      threads.emplace_back([this, worker_id](std::stop_token token) {
+        work(token, worker_id);
+      });
+    }
+  }
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  ~WorkerPool() {
+    for (auto& thread : threads) {
+      thread.request_stop();
+    }
+    generation.fetch_add(1, std::memory_order_release);
+    generation.notify_all();
+    threads.clear();
+  }
+
+  size_t size() const noexcept {
+    return n_threads;
+  }
+
+  // `job(worker_id)` is called once by every worker; `job` must stay alive until `wait()` returns
+  template <typename Job>
+  void start(Job& job) noexcept {
+    started_at = std::chrono::steady_clock::now();
+    job_context = &job;
+    job_function = [](void* context, size_t worker_id) {
+      (*static_cast<Job*>(context))(worker_id);
+    };
+    generation.fetch_add(1, std::memory_order_release);
+    generation.notify_all();
+  }
+
+  void wait() const noexcept {
+    size_t current = generation.load(std::memory_order_relaxed);
+    for (size_t worker_id = 0; worker_id < n_threads; ++worker_id) {
+      spin_wait(workers[worker_id].done, [current](size_t done) {
+        return done == current;
+      });
+    }
+  }
+
+  // whether the last started job has completed
+  bool done() const noexcept {
+    size_t current = generation.load(std::memory_order_relaxed);
+    for (size_t worker_id = 0; worker_id < n_threads; ++worker_id) {
+      if (workers[worker_id].done.load(std::memory_order_acquire) != current) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // timings of the last job, which must have completed
+  void collect(StepStats& stats) const {
+    stats.compute.resize(n_threads);
+    stats.wait.resize(n_threads);
+    auto finished = started_at;
+    StepStats::Duration total{};
+    StepStats::Duration slowest{};
+    for (size_t worker_id = 0; worker_id < n_threads; ++worker_id) {
+      finished = std::max(finished, workers[worker_id].finished);
+      stats.compute[worker_id] = workers[worker_id].busy;
+      total += workers[worker_id].busy;
+      slowest = std::max(slowest, workers[worker_id].busy);
+    }
+    stats.wall = finished - started_at;
+    for (size_t worker_id = 0; worker_id < n_threads; ++worker_id) {
+      stats.wait[worker_id] = std::max(stats.wall - stats.compute[worker_id], StepStats::Duration{});
+    }
+    stats.imbalance = total.count() > 0 ? static_cast<double>(slowest.count()) * n_threads / total.count() : 1;
+  }
+
+  template <typename Job>
+  void run(Job& job) noexcept {
+    start(job);
+    wait();
+  }
+
+private:
+  struct alignas(cache_line_size) Worker {
+    std::atomic<size_t> done = 0;
+    std::chrono::steady_clock::duration busy{};
+    std::chrono::steady_clock::time_point finished;
+  };
+
+  void work(const std::stop_token& token, size_t worker_id) {
+    size_t seen = 0;
+    while (true) {
+      spin_wait(generation, [seen](size_t current) {
+        return current != seen;
+      });
+      seen = generation.load(std::memory_order_acquire);
+      if (token.stop_requested()) {
+        return;
+      }
+      auto begin = std::chrono::steady_clock::now();
+      job_function(job_context, worker_id);
+      workers[worker_id].finished = std::chrono::steady_clock::now();
+      workers[worker_id].busy = workers[worker_id].finished - begin;
+      workers[worker_id].done.store(seen, std::memory_order_release);
+      workers[worker_id].done.notify_one();
+    }
+  }
+
+  alignas(cache_line_size) std::atomic<size_t> generation = 0;
+  std::chrono::steady_clock::time_point started_at;
+  void* job_context = nullptr;
+  void (*job_function)(void*, size_t) = nullptr;
+  std::unique_ptr<Worker[]> workers;
+  size_t n_threads;
+  std::vector<std::jthread> threads;
+};
+
+// Tiles of a job, initially split into equal contiguous ranges. A worker takes tiles from the front of its own
+// range and, once it is empty, steals single tiles from the back of the others' ranges, so a range only ever
+// shrinks and a compare-and-swap on its packed bounds is enough to hand out every tile exactly once
+class TileScheduler {
+public:
+  static constexpr size_t none = static_cast<size_t>(-1);
+
+  explicit TileScheduler(size_t n_workers)
+      : ranges(std::make_unique<Range[]>(n_workers))
+      , n_workers(n_workers) {}
+
+  // must not overlap with a job, the pool publishes the ranges to the workers when it starts the next one
+  void reset(size_t tiles) noexcept {
+    for (size_t worker_id = 0; worker_id < n_workers; ++worker_id) {
+      ranges[worker_id].bounds.store(
+          pack(tiles * worker_id / n_workers, tiles * (worker_id + 1) / n_workers),
+          std::memory_order_relaxed
+      );
+    }
+  }
+
+  // the next tile for the worker, or `none` when all tiles are taken
+  size_t next(size_t worker_id) noexcept {
+    if (size_t tile = take(ranges[worker_id], true); tile != none) {
+      return tile;
+    }
+    for (size_t i = 1; i < n_workers; ++i) {
+      if (size_t tile = take(ranges[(worker_id + i) % n_workers], false); tile != none) {
+        return tile;
+      }
+    }
+    return none;
+  }
+
+private:
+  struct alignas(cache_line_size) Range {
+    std::atomic<std::uint64_t> bounds = 0;
+  };
+
+  static std::uint64_t pack(size_t begin, size_t end) noexcept {
+    return static_cast<std::uint64_t>(begin) << 32 | end;
+  }
+
+  static size_t take(Range& range, bool front) noexcept {
+    std::uint64_t bounds = range.bounds.load(std::memory_order_relaxed);
+    while (true) {
+      size_t begin = bounds >> 32;
+      size_t end = bounds & 0xffffffff;
+      if (begin >= end) {
+        return none;
+      }
+      std::uint64_t rest = front ? pack(begin + 1, end) : pack(begin, end - 1);
+      if (range.bounds.compare_exchange_weak(bounds, rest, std::memory_order_relaxed)) {
+        return front ? begin : end - 1;
+      }
+    }
+  }
+
+  std::unique_ptr<Range[]> ranges;
+  size_t n_workers;
+};
+
+// A `WorkerPool` computing at most one step in the background, with the bookkeeping behind `StepHandle`: a
+// ticket identifies a step by the number of steps started before it, and the timings of the last finished job
+// are kept for `stats()`
+class StepPool {
+public:
+  explicit StepPool(size_t n_threads)
+      : workers(std::max<size_t>(n_threads, 1)) {
+    // collected after every step, sized up front so that completing a step does not allocate
+    workers.collect(last_stats);
+  }
+
+  size_t size() const noexcept {
+    return workers.size();
+  }
+
+  // starts a step computed by `job`, which must stay alive until `finish()`, and returns its ticket
+  template <typename Job>
+  size_t start(Job& job) noexcept {
+    workers.start(job);
+    pending = true;
+    return started++;
+  }
+
+  // ticket of a step with nothing to compute
+  size_t skip() noexcept {
+    return started++;
+  }
+
+  // runs a job outside of the step protocol, there must be no pending step
+  template <typename Job>
+  void run(Job& job) noexcept {
+    workers.run(job);
+    workers.collect(last_stats);
+  }
+
+  bool done(size_t ticket) const noexcept {
+    return !pending || !last(ticket) || workers.done();
+  }
+
+  // whether no step was started after the one with `ticket`
+  bool last(size_t ticket) const noexcept {
+    return ticket + 1 == started;
+  }
+
+  // waits for the pending step, if any; returns whether there was one, whose result the caller then publishes
+  bool finish() noexcept {
+    if (!pending) {
+      return false;
+    }
+    workers.wait();
+    workers.collect(last_stats);
+    pending = false;
+    return true;
+  }
+
+  const StepStats& stats() const noexcept {
+    return last_stats;
+  }
+
+private:
+  WorkerPool workers;
+  StepStats last_stats;
+  bool pending = false;
+  size_t started = 0;
+};
+} // namespace ct::detail
@@ -1,9 +1,19 @@
 #include <iostream>
 #include <string>
+#include <string_view>
 
 #include "acp/Allocator.hpp"
 #include "acp/Cache.hpp"
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
 #include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 namespace {
 
 constexpr unsigned upper_bin_power(const std::size_t n) {
@@ -28,11 +38,143 @@ struct String {
     }
 };
 
+// Same as String, but silent: used when replaying traces, where per-entry output would dominate the timing
+struct Entry {
+    std::string data;
+    bool marked = false;
+
+    Entry(const std::string& key) : data(key) {}
+
+    bool operator==(const std::string& other) const { return data == other; }
+
+    friend std::ostream& operator<<(std::ostream& strm, const Entry& entry) { return strm << entry.data; }
+};
+
 using TestCache = Cache<std::string, String, AllocatorWithPool>;
 
+class Trace {
+public:
+    explicit Trace(const char* path) {
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st{};
+        if (::fstat(fd, &st) == 0) {
+            // an empty file is a valid trace without keys; mmap rejects zero-length mappings
+            opened = st.st_size == 0;
+            if (st.st_size > 0) {
+                void* addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr != MAP_FAILED) {
+                    ::madvise(addr, st.st_size, MADV_SEQUENTIAL);
+                    data = static_cast<const char*>(addr);
+                    size = st.st_size;
+                    opened = true;
+                }
+            }
+        }
+        ::close(fd);
+        split();
+    }
+
+    Trace(const Trace&) = delete;
+    Trace& operator=(const Trace&) = delete;
+
+    ~Trace() {
+        if (data) {
+            ::munmap(const_cast<char*>(data), size);
+        }
+    }
+
+    bool valid() const { return opened; }
+
+    const std::vector<std::string_view>& keys() const { return lines; }
+
+private:
+    void split() {
+        std::string_view rest(data, size);
+        while (!rest.empty()) {
+            const auto end = rest.find('\n');
+            auto line = rest.substr(0, end);
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            if (!line.empty()) {
+                lines.push_back(line);
+            }
+            if (end == std::string_view::npos) {
+                break;
+            }
+            rest.remove_prefix(end + 1);
+        }
+    }
+
+    bool opened = false;
+    const char* data = nullptr;
+    std::size_t size = 0;
+    std::vector<std::string_view> lines;
+};
+
+template <class CacheType>
+void replay(const char* policy, const Trace& trace, const std::size_t cache_size) {
+    using Value = Entry;
+    const std::size_t min_power = upper_bin_power(sizeof(Value));
+    CacheType cache(cache_size, min_power, upper_bin_power((1UL << min_power) * (cache_size + 1)));
+
+    std::size_t hits = 0;
+    std::string key;
+    const auto start = std::chrono::steady_clock::now();
+    for (const auto line : trace.keys()) {
+        key.assign(line);
+        auto& entry = cache.template get<Value>(key);
+        hits += entry.marked;
+        entry.marked = true;
+    }
+    const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    const std::size_t ops = trace.keys().size();
+    std::cout << policy << ": ops=" << ops << " hits=" << hits << " hit_ratio="
+              << (ops ? static_cast<double>(hits) / ops : 0.0) << " ns/op=" << (ops ? elapsed / ops : 0.0) << "\n";
+}
+
+void print_usage(const char* program) {
+    std::cerr << "usage: " << program << "                       - interactive mode, keys are read from stdin\n"
+              << "       " << program << " <trace> [cache_size]  - replays a newline-separated key trace through "
+              << "the second-chance cache (cache_size > 0, 9 by default)\n";
+}
+
+// Parses a positive decimal cache size, 0 if the argument is not one
+std::size_t parse_cache_size(const char* arg) {
+    if (!std::isdigit(static_cast<unsigned char>(*arg))) {
+        return 0;
+    }
+    char* end = nullptr;
+    errno = 0;
+    const std::size_t size = std::strtoul(arg, &end, 10);
+    return *end == '\0' && errno == 0 ? size : 0;
+}
+
+int run_trace(const char* path, const std::size_t cache_size) {
+    Trace trace(path);
+    if (!trace.valid()) {
+        std::cerr << "cannot read trace " << path << "\n";
+        return 1;
+    }
+    replay<Cache<std::string, Entry, AllocatorWithPool>>("second-chance", trace, cache_size);
+    return 0;
+}
+
 }  // anonymous namespace
 
-int main() {
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        const std::size_t cache_size = argc > 2 ? parse_cache_size(argv[2]) : 9;
+        if (cache_size == 0) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        return run_trace(argv[1], cache_size);
+    }
     const std::size_t min_power = upper_bin_power(sizeof(String));
     TestCache cache(9, min_power, upper_bin_power((1UL << min_power) * 10));
     std::string line;